@@ -0,0 +1,50 @@
+#pragma once
+#include "useful.h"
+#include "core/nes/blip.h"
+#include "core/nes/bus.h"
+
+#define APU_SAMPLE_RATE 48000   /* 前端不提供目标采样率时使用 */
+#define APU_FRAME_SAMPLES BLIP_MAX_FRAME  /* 一帧最多产生的采样数 */
+#define APU_EXPANSION_MAX 6     /* 同时挂接的扩展音源数，NSF 最多使用 6 种 */
+
+/*
+ * 扩展音源：卡带上的声音芯片（VRC6、VRC7、N163、5B、MMC5、FDS）由 mapper 注册。
+ * APU 追赶时一并调用 run，芯片在 [from, to) 个 CPU 周期内按自己的节拍运行，
+ * 输出变化时调用 apu_expansion_output，与 2A03 混入同一合成缓冲。
+ */
+typedef int expansion_id;
+typedef void (*expansion_fn)(void *chip, u64 from, u64 to);
+
+enum apu_channel
+{
+    APU_PULSE1 = 0,
+    APU_PULSE2,
+    APU_TRIANGLE,
+    APU_NOISE,
+    APU_DMC,
+    APU_CH_NUM,
+};
+
+/* 分声道采集：每个 2A03 声道单独混音输出，扩展音源合为一路 */
+#define APU_CAPTURE_EXPANSION APU_CH_NUM
+#define APU_CAPTURE_NUM (APU_CH_NUM + 1)
+
+dev_id apu_init(void);
+void apu_reset(void);
+
+void apu_set_sample_rate(double rate);
+double apu_sample_rate(void);
+void apu_set_audio(int enable);
+int apu_audio(void);
+void apu_set_capture(int enable);
+int apu_capture(void);
+
+void apu_end_frame(void);
+unsigned apu_samples_avail(void);
+unsigned apu_read_samples(s16 *out, unsigned count, int stereo);
+unsigned apu_read_capture(unsigned ch, s16 *out, unsigned count);
+
+expansion_id apu_expansion_register(char *name, expansion_fn run, void *chip);
+void apu_expansion_remove(expansion_id id);
+void apu_expansion_output(expansion_id id, int amp, u64 when);
+void apu_expansion_sync(void);
@@ -0,0 +1,27 @@
+#pragma once
+#include "useful.h"
+
+/*
+ * 带限阶跃合成：声道电平只在变化时向缓冲加入一个带限阶跃（即其导数，带限冲激），
+ * 读取时积分得到采样。合成直接在输出采样率下进行，不需要逐时钟运行再重采样。
+ */
+#define BLIP_MAX_RATE 96000     /* 支持的最高输出采样率 */
+#define BLIP_MAX_FRAME 2048     /* 一帧最多产生的采样数，制式最低帧率 50 */
+#define BLIP_WIDTH 16           /* 冲激核宽度（采样） */
+#define BLIP_FRAC_BITS 32       /* 采样位置的小数位数 */
+
+struct blip
+{
+    u64 factor;     /* 每个时钟对应的采样数，BLIP_FRAC_BITS 位小数 */
+    u64 offset;     /* 帧起点对应的采样位置 */
+    s32 integrator;
+    s32 buf[BLIP_MAX_FRAME * 2 + BLIP_WIDTH];
+};
+
+void blip_init(void);
+void blip_set_rates(struct blip *b, double clock_rate, double sample_rate);
+void blip_clear(struct blip *b);
+void blip_add_delta(struct blip *b, u32 clock, int delta);
+void blip_end_frame(struct blip *b, u32 clocks);
+unsigned blip_samples_avail(const struct blip *b);
+unsigned blip_read_samples(struct blip *b, s16 *out, unsigned count, int stereo);
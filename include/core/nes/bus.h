@@ -16,6 +16,8 @@
 #define CART_MAP_BASE 0x8000
 #define CART_MAP_SIZE 0x8000
 
+#define BUS_PAGE_SIZE 0x100
+
 typedef int dev_id;
 typedef u8 (*read_fn)(u16 addr);
 typedef void (*write_fn)(u16 addr, u8 data);
@@ -24,4 +26,7 @@ dev_id bus_register(char *dev_name, u16 addr, u16 len,  read_fn, write_fn);
 void bus_remove(dev_id dev);
 
 u8 bus_read(u16 addr);
-void bus_write(u16 addr, u8 data);
\ No newline at end of file
+void bus_write(u16 addr, u8 data);
+
+void bus_map_direct(u16 addr, u32 len, const u8 *mem);
+u8 bus_read_direct(u16 addr);
\ No newline at end of file
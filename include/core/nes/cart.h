@@ -0,0 +1,36 @@
+#pragma once
+#include <stddef.h>
+#include "useful.h"
+#include "core/nes/bus.h"
+#include "core/nes/ppu.h"
+#include "core/nes/region.h"
+
+#define CART_HEADER_SIZE 16
+#define CART_TRAINER_SIZE 0x200
+#define CART_PRG_RAM_SIZE 0x2000    /* $6000-$7FFF */
+
+/* iNES / NES 2.0 文件头解析结果，prg 与 chr 直接指向镜像数据，不复制 */
+struct cart_info
+{
+    const u8 *prg;
+    u32 prg_size;
+    const u8 *chr;
+    u32 chr_size;           /* 0 表示使用 CHR-RAM */
+    const u8 *trainer;      /* 无 trainer 时为 NULL */
+    u16 mapper;
+    u8 submapper;
+    u8 nes2;                /* 是否为 NES 2.0 文件头 */
+    u8 battery;
+    enum ppu_mirror mirror;
+    enum region region;
+    u32 prg_ram_size;
+    u32 chr_ram_size;
+};
+
+int cart_parse(struct cart_info *info, const u8 *data, size_t size);
+
+int cart_load(const u8 *data, size_t size);
+int cart_load_file(const char *path);
+void cart_unload(void);
+void cart_reset(void);
+const struct cart_info *cart_info(void);
@@ -0,0 +1,19 @@
+#pragma once
+#include "useful.h"
+
+#define CHR_BANK_SIZE 0x400
+#define CHR_BANK_TILES 64
+
+/* 解码后的 1KB bank：每个图块 8 行，每行 8 个像素，每像素一字节（0-3） */
+struct chr_bank
+{
+    u8 tile[CHR_BANK_TILES][8][8];
+};
+
+void chr_decode_bank(struct chr_bank *out, const u8 *raw);
+void chr_decode_row(struct chr_bank *out, const u8 *raw, u16 offset);
+
+int chr_cache_attach(const u8 *raw, size_t size);
+void chr_cache_detach(const u8 *raw);
+void chr_cache_reset(void);
+struct chr_bank *chr_cache_lookup(const u8 *raw);
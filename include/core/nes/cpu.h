@@ -2,6 +2,7 @@
 #include <stdint.h>
 #include "useful.h"
 #include "core/nes/bus.h"
+#include "core/nes/region.h"
 
 struct operation {
     void (*instruction_func)(u16);
@@ -13,5 +14,16 @@ struct operation {
 };
 struct operation * get_operation();
 
+#define CPU_IRQ_APU     0x01
+#define CPU_IRQ_DMC     0x02
+#define CPU_IRQ_MAPPER  0x04
+
 dev_id cpu_init();
+void cpu_reset();
 void cpu_clock();
+#define CPU_RUN_DECLARE(ID, name, ...) void cpu_run_##name();
+REGION_LIST(CPU_RUN_DECLARE)
+#undef CPU_RUN_DECLARE
+void cpu_nmi();
+void cpu_irq(u8 source, u8 level);
+void cpu_stall(u16 cycles);
@@ -0,0 +1,29 @@
+#pragma once
+#include "useful.h"
+#include "core/nes/apu.h"
+
+/*
+ * Namco 163 扩展音源（mapper 19）：128 字节内部 RAM 同时存放波表与声道寄存器，
+ * 最多 8 个声道分时复用一个 DAC，每 15 个 CPU 周期更新一个声道。
+ * 结构体按实例使用，由 mapper 持有并转发 $4800、$E000、$F800 的访问。
+ */
+#define N163_RAM_SIZE 0x80
+#define N163_CH_NUM 8
+#define N163_REG_BASE 0x40      /* 声道 0 寄存器在 RAM 中的地址，每声道 8 字节 */
+
+struct n163
+{
+    u8 ram[N163_RAM_SIZE];
+    u8 addr;            /* $F800 写入的地址，bit7 为自动递增 */
+    u8 disable;         /* $E000 bit6 */
+    u8 channel;         /* 下一个更新的声道 */
+    s8 level[N163_CH_NUM];
+    u64 next;           /* 下一次更新的 CPU 周期 */
+    expansion_id id;
+};
+
+int n163_init(struct n163 *n);
+void n163_remove(struct n163 *n);
+void n163_reset(struct n163 *n);
+u8 n163_read(struct n163 *n, u16 addr);
+void n163_write(struct n163 *n, u16 addr, u8 data);
@@ -0,0 +1,12 @@
+#pragma once
+#include "useful.h"
+#include "core/nes/ppu.h"
+
+/* 每个 PPU 像素输出 2 个像素，显示宽高比与原生画面相同 */
+#define NTSC_WIDTH (PPU_WIDTH * 2)
+#define NTSC_THREAD_MAX 8
+
+void ntsc_init(void);
+int ntsc_set_threads(unsigned num);
+unsigned ntsc_threads(void);
+void ntsc_filter(void *out, size_t pitch, u8 bytes, const u16 *index, unsigned top, unsigned height, unsigned frame);
@@ -0,0 +1,22 @@
+#pragma once
+#include "useful.h"
+
+/* 颜色下标：低 6 位为 NES 颜色，高 3 位为 PPUMASK 的强调位（R、G、B） */
+#define PALETTE_COLORS 64
+#define PALETTE_SIZE 512
+#define PALETTE_INDEX(emphasis, color) (((emphasis) << 6) | (color))
+
+enum palette_format
+{
+    PALETTE_XRGB8888 = 0,
+    PALETTE_RGB565,
+    PALETTE_FORMAT_NUM,
+};
+
+void palette_init(void);
+int palette_load(const char *path);
+
+void palette_set_format(enum palette_format format);
+enum palette_format palette_format(void);
+const u32 *palette_lut(void);
+const u32 *palette_table(enum palette_format format);
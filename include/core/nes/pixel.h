@@ -0,0 +1,21 @@
+#pragma once
+#include "useful.h"
+
+/* 精灵像素：低 5 位为调色板地址，0x20 为背景优先 */
+#define PIXEL_SPR_ADDR      0x1F
+#define PIXEL_SPR_BEHIND    0x20
+
+enum pixel_kernel
+{
+    PIXEL_KERNEL_SCALAR = 0,
+    PIXEL_KERNEL_SSE2,
+    PIXEL_KERNEL_AVX2,
+    PIXEL_KERNEL_NUM,
+};
+
+void pixel_init(void);
+int pixel_select(enum pixel_kernel kernel);
+enum pixel_kernel pixel_kernel(void);
+
+void pixel_compose(u16 *out, const u8 *bg, const u8 *spr, const u16 *lut, unsigned n);
+void pixel_convert(void *out, const u16 *index, const u32 *lut, unsigned n, u8 bytes);
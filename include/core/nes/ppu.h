@@ -0,0 +1,59 @@
+#pragma once
+#include "useful.h"
+#include "core/nes/bus.h"
+
+#define PPU_WIDTH 256
+#define PPU_HEIGHT 240
+
+#define PPU_CHR_BANK_NUM 8
+#define PPU_CHR_RAM_SIZE 0x8000     /* 内部 CHR-RAM，覆盖常见卡带的 8-32KB CHR-RAM */
+
+enum ppu_mirror
+{
+    PPU_MIRROR_HORIZONTAL = 0,
+    PPU_MIRROR_VERTICAL,
+    PPU_MIRROR_SINGLE0,
+    PPU_MIRROR_SINGLE1,
+    PPU_MIRROR_FOUR,
+};
+
+/* 流水线渲染：像素在工作线程中按写入日志生成 */
+enum ppu_pipeline_mode
+{
+    PPU_PIPELINE_OFF = 0,
+    PPU_PIPELINE_ON,
+    PPU_PIPELINE_VALIDATE,  /* 两条路径都渲染并逐帧比较 */
+};
+
+/* 输出画面：帧完成后颜色下标转换到此，只输出 [top, top + height) 范围内的扫描线 */
+struct ppu_surface
+{
+    void *data;
+    size_t pitch;
+    u8 bytes;       /* 每像素字节数：2 为 RGB565，4 为 XRGB8888 */
+    u16 top;
+    u16 height;
+};
+
+dev_id ppu_init();
+void ppu_reset();
+
+void ppu_set_mirroring(enum ppu_mirror mirror);
+void ppu_map_chr(u8 slot, u8 *bank, u8 writable);
+u8 *ppu_chr_ram(void);
+void ppu_oam_dma(u8 page);
+void ppu_set_sprite_limit(int enable);
+
+void ppu_set_surface(const struct ppu_surface *surface);
+const struct ppu_surface *ppu_frame_surface();
+const u32 *ppu_frame();
+const u16 *ppu_frame_index();
+int ppu_frame_dirty();
+void ppu_set_skip(int skip);
+int ppu_frame_skipped();
+void ppu_invalidate();
+
+int ppu_pipeline(enum ppu_pipeline_mode mode);
+enum ppu_pipeline_mode ppu_pipeline_mode(void);
+void ppu_pipeline_submit(void);
+u32 ppu_pipeline_mismatches(void);
@@ -0,0 +1,42 @@
+#pragma once
+#include "useful.h"
+
+/**
+ * 各制式的时序参数，使用 X 宏展开。
+ * 热点循环（CPU 批次、帧循环等）按制式各实例化一份，分频等参数在编译期为常量，
+ * 运行时只在每帧入口按制式选择一次函数。
+ *
+ *  ID     名称    主时钟(Hz) CPU分频 PPU分频 扫描线 vblank线 奇帧跳点 APU帧计数器四分之一帧(CPU周期)
+ */
+#define REGION_LIST(X) \
+    X(NTSC,  ntsc,  21477272, 12, 4, 262, 241, 1, 7457) \
+    X(PAL,   pal,   26601712, 16, 5, 312, 241, 0, 8313) \
+    X(DENDY, dendy, 26601712, 15, 5, 312, 291, 0, 7457)
+
+#define REGION_DOTS_PER_LINE 341
+#define REGION_FRAME_CYCLES(ppu_div, lines) ((u64)REGION_DOTS_PER_LINE * (lines) * (ppu_div))
+
+#define REGION_ENUM(ID, name, hz, cpu_div, ppu_div, lines, vblank_line, odd_skip, apu_quarter) \
+    REGION_##ID,
+enum region
+{
+    REGION_LIST(REGION_ENUM)
+    REGION_NUM
+};
+#undef REGION_ENUM
+
+struct region_timing
+{
+    const char *name;
+    u32 master_hz;      /* 主时钟频率 */
+    u8 cpu_div;         /* CPU 周期对应的主时钟周期数 */
+    u8 ppu_div;         /* PPU 点对应的主时钟周期数 */
+    u16 lines;          /* 每帧扫描线数，含 pre-render 线 */
+    u16 vblank_line;    /* 进入 vblank 的扫描线 */
+    u8 odd_skip;        /* 渲染开启时奇数帧是否跳过一个点 */
+    u16 apu_quarter;    /* APU 帧计数器每四分之一帧的 CPU 周期数 */
+    u64 frame_cycles;   /* 每帧主时钟周期数 */
+    double fps;
+};
+
+extern const struct region_timing region_timings[REGION_NUM];
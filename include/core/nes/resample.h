@@ -0,0 +1,22 @@
+#pragma once
+#include "useful.h"
+#include "core/nes/simd.h"
+
+/*
+ * 整数倍多相插值：合成采样率受限于 BLIP_MAX_RATE，前端要求更高的采样率时
+ * 以其整数分之一合成，再在此升采样。每个输出相位是一组 16 抽头的 FIR。
+ */
+#define RESAMPLE_TAPS 16
+#define RESAMPLE_MAX_RATIO 4
+
+struct resample
+{
+    unsigned ratio;
+    enum simd_level level;
+    s16 kernel[RESAMPLE_MAX_RATIO][RESAMPLE_TAPS] __attribute__((aligned(32)));
+    s16 history[RESAMPLE_TAPS - 1];
+};
+
+void resample_init(struct resample *r, unsigned ratio);
+int resample_select(struct resample *r, enum simd_level level);
+unsigned resample_run(struct resample *r, s16 *out, const s16 *in, unsigned n);
@@ -0,0 +1,50 @@
+#pragma once
+#include "useful.h"
+#include "core/nes/region.h"
+
+#define SCHED_NEVER UINT64_MAX
+
+typedef int sched_id;
+typedef int event_id;
+typedef void (*sync_fn)(u64 until);
+typedef void (*event_fn)(u64 when);
+
+struct sched
+{
+    u64 clock;      /* 主时钟周期，即 CPU 当前所处的时刻 */
+    u64 deadline;   /* 本批次 CPU 最多运行到的时刻，即缓存的下一个事件时刻 */
+    u64 frame_end;  /* 当前帧结束的时刻 */
+    u64 batches;    /* 本帧 CPU 批次数量，用于统计组件切换次数 */
+    enum region region;
+    const struct region_timing *timing;
+};
+extern struct sched g_sched;
+
+sched_id sched_register(char *dev_name, sync_fn sync);
+void sched_remove(sched_id id);
+void sched_reset(void);
+void sched_set_region(enum region region);
+
+void sched_sync(sched_id id);
+void sched_sync_frame(sched_id id);
+void sched_break(void);
+
+event_id sched_event_register(char *event_name, event_fn fire);
+void sched_event_remove(event_id id);
+void sched_event_schedule(event_id id, u64 when);
+void sched_event_reschedule(event_id id, u64 when);
+void sched_event_cancel(event_id id);
+int sched_event_pending(event_id id);
+u64 sched_event_time(event_id id);
+
+void sched_run_frame(void);
+
+/**
+ * @brief  获取当前主时钟周期
+ * @retval 当前时刻
+ * @note 在 CPU 批次内调用时返回当前指令开始的时刻。
+ */
+static inline u64 sched_now(void)
+{
+    return g_sched.clock;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "useful.h"
+
+/*
+ * 向量化实现的公共部分：x86 上用 GCC/Clang 的 target 属性逐函数启用指令集，
+ * 同一个二进制按运行时检测到的 CPU 特性选择实现，其他平台只有标量实现。
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#  define SIMD_X86 1
+#  include <immintrin.h>
+#  define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#  define SIMD_X86 0
+#endif
+
+enum simd_level
+{
+    SIMD_SCALAR = 0,
+    SIMD_SSE2,
+    SIMD_AVX2,
+    SIMD_LEVEL_NUM,
+};
+
+int simd_supported(enum simd_level level);
+enum simd_level simd_best(void);
+const char *simd_name(enum simd_level level);
@@ -25,4 +25,12 @@ typedef int64_t s64;
 #define CLEAR_BIT(reg, bit) ((reg) &= ~(1 << (bit)))
 #define TEST_BIT(reg, bit) (((reg) & (1 << (bit))) != 0)
 #define TOGGLE_BIT(reg, bit) ((reg) ^= (1 << (bit)))
+
+#if defined(__GNUC__) || defined(__clang__)
+#  define FORCE_INLINE static inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#  define FORCE_INLINE static __forceinline
+#else
+#  define FORCE_INLINE static inline
+#endif
 // #define shift(xs, xs_sz) (NOB_ASSERT((xs_sz) > 0), (xs_sz)--, *(xs)++)
\ No newline at end of file
@@ -0,0 +1,1112 @@
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include "log.h"
+#include "core/nes/apu.h"
+#include "core/nes/blip.h"
+#include "core/nes/cpu.h"
+#include "core/nes/ppu.h"
+#include "core/nes/sched.h"
+
+#pragma region "寄存器"
+enum apu_reg_map
+{
+    APU_REG_PULSE1 = 0x00,
+    APU_REG_PULSE2 = 0x04,
+    APU_REG_TRIANGLE = 0x08,
+    APU_REG_NOISE = 0x0C,
+    APU_REG_DMC = 0x10,
+    APU_REG_OAM_DMA = 0x14,
+    APU_REG_STATUS = 0x15,
+    APU_REG_JOY1 = 0x16,
+    APU_REG_FRAME = 0x17,
+};
+
+#define APU_VOLUME 28000    /* 混音输出 1.0 对应的采样值 */
+#define APU_OPEN_BUS 0x40   /* 只写寄存器及未接手柄时读到的值 */
+#define APU_DMC_STALL 4     /* DMC 读取占用的 CPU 周期，未区分与写周期或 OAM DMA 重叠的情况 */
+
+struct apu_envelope
+{
+    u8 start;
+    u8 loop;        /* 同时是长度计数器暂停标志 */
+    u8 constant;
+    u8 period;      /* 同时是常量音量 */
+    u8 divider;
+    u8 decay;
+};
+
+struct apu_pulse
+{
+    struct apu_envelope env;
+    u8 duty;
+    u8 step;
+    u16 timer;
+    u8 length;
+    u8 sweep_enable;
+    u8 sweep_period;
+    u8 sweep_negate;
+    u8 sweep_shift;
+    u8 sweep_divider;
+    u8 sweep_reload;
+    u64 next;       /* 下一次定时器输出时钟的 CPU 周期 */
+};
+
+struct apu_triangle
+{
+    u16 timer;
+    u8 step;
+    u8 length;
+    u8 control;     /* 同时是长度计数器暂停标志 */
+    u8 linear;
+    u8 linear_period;
+    u8 linear_reload;
+    u64 next;
+};
+
+struct apu_noise
+{
+    struct apu_envelope env;
+    u8 mode;
+    u8 period;
+    u16 lfsr;
+    u8 length;
+    u64 next;
+};
+
+struct apu_dmc
+{
+    u8 irq_enable;
+    u8 loop;
+    u8 rate;
+    u8 level;
+    u16 start;
+    u16 size;
+    u16 addr;
+    u16 bytes;      /* 剩余未读取的字节数 */
+    u8 buffer;
+    u8 buffer_full;
+    u8 shift;
+    u8 bits;
+    u8 silence;
+    u64 next;
+};
+
+struct apu_expansion
+{
+    char *name;
+    expansion_fn run;
+    void *chip;
+    u64 cycle;      /* 已运行到的 CPU 周期 */
+    int amp;        /* 当前输出，已按采样值缩放 */
+};
+
+struct apu
+{
+    struct apu_pulse pulse[2];
+    struct apu_triangle triangle;
+    struct apu_noise noise;
+    struct apu_dmc dmc;
+    u8 enabled;         /* $4015 写入的声道使能 */
+
+    /* 帧计数器 */
+    u8 frame_mode;      /* 0: 4 步, 1: 5 步 */
+    u8 frame_inhibit;
+    u8 frame_irq;
+    u8 dmc_irq;
+    u8 frame_step;      /* 下一步的序号 */
+    u64 frame_start;    /* 当前序列起点的 CPU 周期 */
+    u64 frame_next;     /* 下一步的 CPU 周期 */
+
+    /* 追赶与合成 */
+    u64 cycle;          /* 已追赶到的 CPU 周期 */
+    u64 frame_base;     /* 合成缓冲当前帧起点的 CPU 周期 */
+    u8 level[APU_CH_NUM];
+    int amp;            /* 当前混音输出 */
+    double rate;
+    u8 audio;           /* 0 时只模拟可观测的状态，不合成波形 */
+    int expansion_amp;  /* 关闭音频时合成缓冲中扩展音源的输出之和 */
+    struct apu_expansion expansion[APU_EXPANSION_MAX];
+    u8 capture;         /* 非 0 时每个声道另外合成到 capture_blip */
+    struct blip blip;
+    struct blip capture_blip[APU_CAPTURE_NUM];
+};
+
+static struct apu __apu;
+static sched_id apu_sched_id = RET_ERR;
+static event_id apu_irq_event = RET_ERR;
+static event_id apu_dmc_event = RET_ERR;
+
+static const u8 length_table[32] = {
+    10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
+    12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30,
+};
+
+static const u8 duty_table[4][8] = {
+    { 0, 1, 0, 0, 0, 0, 0, 0 },
+    { 0, 1, 1, 0, 0, 0, 0, 0 },
+    { 0, 1, 1, 1, 1, 0, 0, 0 },
+    { 1, 0, 0, 1, 1, 1, 1, 1 },
+};
+
+static const u8 triangle_table[32] = {
+    15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+};
+
+/* 噪声与 DMC 的定时器周期（CPU 周期），PAL 一套，NTSC 与 Dendy 共用一套 */
+static const u16 noise_table[2][16] = {
+    { 4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068 },
+    { 4, 8, 14, 30, 60, 88, 118, 148, 188, 236, 354, 472, 708, 944, 1890, 3778 },
+};
+
+static const u16 dmc_table[2][16] = {
+    { 428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54 },
+    { 398, 354, 316, 298, 276, 236, 210, 198, 176, 148, 132, 118, 98, 78, 66, 50 },
+};
+
+/* 混音表：下标分别为两路方波电平之和、3 * 三角波 + 2 * 噪声 + DMC */
+static s16 pulse_mix[31];
+static s16 tnd_mix[203];
+#pragma endregion
+
+#pragma region "输出"
+/**
+ * @brief  生成混音表
+ * @retval 无
+ * @note 方波与三角波、噪声、DMC 两组的非线性公式预先按输出采样值算好。
+ */
+static void apu_build_mixer(void)
+{
+    pulse_mix[0] = tnd_mix[0] = 0;
+    for (int i = 1; i < (int)ARRARY_LEN(pulse_mix); i++)
+        pulse_mix[i] = (s16)lrint(95.52 / (8128.0 / i + 100) * APU_VOLUME);
+    for (int i = 1; i < (int)ARRARY_LEN(tnd_mix); i++)
+        tnd_mix[i] = (s16)lrint(163.67 / (24329.0 / i + 100) * APU_VOLUME);
+}
+
+/**
+ * @brief  2A03 非线性混音
+ * @param  level 各声道电平
+ * @retval 输出采样值
+ */
+static inline int apu_mix(const u8 *level)
+{
+    return pulse_mix[level[APU_PULSE1] + level[APU_PULSE2]]
+         + tnd_mix[3 * level[APU_TRIANGLE] + 2 * level[APU_NOISE] + level[APU_DMC]];
+}
+
+/**
+ * @brief  单个声道独立混音的输出
+ * @param  ch 声道
+ * @param  level 电平
+ * @retval 输出采样值
+ * @note 其他声道为 0 时的 2A03 混音结果，与分别静音其他声道运行一致。
+ */
+static inline int apu_solo(enum apu_channel ch, u8 level)
+{
+    static const u8 tnd_weight[APU_CH_NUM] = {[APU_TRIANGLE] = 3, [APU_NOISE] = 2, [APU_DMC] = 1};
+    if(ch == APU_PULSE1 || ch == APU_PULSE2)
+        return pulse_mix[level];
+    return tnd_mix[tnd_weight[ch] * level];
+}
+
+/**
+ * @brief  更新声道电平
+ * @param  a APU
+ * @param  ch 声道
+ * @param  level 新电平
+ * @param  when 变化时刻（CPU 周期）
+ * @retval 无
+ * @note 电平不变或关闭音频时没有任何开销，变化时向合成缓冲加入一个阶跃。
+ */
+static inline void apu_output(struct apu *a, enum apu_channel ch, u8 level, u64 when)
+{
+    if(!a->audio || a->level[ch] == level)
+        return;
+    if(a->capture)
+        blip_add_delta(&a->capture_blip[ch], when - a->frame_base, apu_solo(ch, level) - apu_solo(ch, a->level[ch]));
+    a->level[ch] = level;
+    int amp = apu_mix(a->level);
+    blip_add_delta(&a->blip, when - a->frame_base, amp - a->amp);
+    a->amp = amp;
+}
+
+static u8 apu_envelope_volume(const struct apu_envelope *env)
+{
+    return env->constant ? env->period : env->decay;
+}
+
+static u16 apu_sweep_target(const struct apu_pulse *p, enum apu_channel ch)
+{
+    u16 change = p->timer >> p->sweep_shift;
+    if(!p->sweep_negate)
+        return p->timer + change;
+    /* 1 号方波取反码，2 号方波取补码 */
+    return p->timer - change - (ch == APU_PULSE1);
+}
+
+/* 周期过短或扫频目标溢出时静音，与长度计数器、包络无关，也决定扫频是否更新周期 */
+static int apu_pulse_muted(const struct apu_pulse *p, enum apu_channel ch)
+{
+    return p->timer < 8 || apu_sweep_target(p, ch) > 0x7FF;
+}
+
+static u8 apu_pulse_volume(const struct apu_pulse *p, enum apu_channel ch)
+{
+    if(p->length == 0 || apu_pulse_muted(p, ch))
+        return 0;
+    return apu_envelope_volume(&p->env);
+}
+
+static u8 apu_noise_volume(const struct apu_noise *n)
+{
+    if(n->length == 0)
+        return 0;
+    return apu_envelope_volume(&n->env);
+}
+
+/**
+ * @brief  按当前状态计算各声道电平
+ * @param  a APU
+ * @param  level 输出的各声道电平
+ * @retval 无
+ */
+static void apu_levels(const struct apu *a, u8 *level)
+{
+    for (int ch = APU_PULSE1; ch <= APU_PULSE2; ch++)
+    {
+        const struct apu_pulse *p = &a->pulse[ch];
+        level[ch] = duty_table[p->duty][p->step] ? apu_pulse_volume(p, ch) : 0;
+    }
+    level[APU_TRIANGLE] = triangle_table[a->triangle.step];
+    level[APU_NOISE] = (a->noise.lfsr & 1) ? 0 : apu_noise_volume(&a->noise);
+    level[APU_DMC] = a->dmc.level;
+}
+
+/**
+ * @brief  按当前状态更新各声道电平
+ * @param  a APU
+ * @retval 无
+ * @note 寄存器写入与帧计数器时钟之后调用。
+ */
+static void apu_refresh(struct apu *a)
+{
+    u8 level[APU_CH_NUM];
+    apu_levels(a, level);
+    for (int ch = 0; ch < APU_CH_NUM; ch++)
+        apu_output(a, ch, level[ch], a->cycle);
+}
+#pragma endregion
+
+#pragma region "声道"
+/*
+ * 各声道只在定时器时钟处计算电平，电平不变的区间直接跳过。
+ * 定时器时钟 next 早于 stop 的都在本次处理。
+ */
+
+static void apu_run_pulse(struct apu *a, enum apu_channel ch, u64 stop)
+{
+    struct apu_pulse *p = &a->pulse[ch];
+    u32 period = (p->timer + 1) * 2;
+    u8 volume = apu_pulse_volume(p, ch);
+    if(p->next >= stop)
+        return;
+    if(volume == 0)
+    {
+        u64 n = (stop - p->next + period - 1) / period;
+        p->step = (p->step + n) & 7;
+        p->next += n * period;
+        return;
+    }
+    const u8 *duty = duty_table[p->duty];
+    while (p->next < stop)
+    {
+        p->step = (p->step + 1) & 7;
+        apu_output(a, ch, duty[p->step] ? volume : 0, p->next);
+        p->next += period;
+    }
+}
+
+static void apu_run_triangle(struct apu *a, u64 stop)
+{
+    struct apu_triangle *t = &a->triangle;
+    u32 period = t->timer + 1;
+    if(t->next >= stop)
+        return;
+    /* 计数器为 0 时序列停在当前电平；超声频率下同样保持，避免逐周期运行 */
+    if(t->length == 0 || t->linear == 0 || t->timer < 2)
+    {
+        t->next += (stop - t->next + period - 1) / period * period;
+        return;
+    }
+    while (t->next < stop)
+    {
+        t->step = (t->step + 1) & 31;
+        apu_output(a, APU_TRIANGLE, triangle_table[t->step], t->next);
+        t->next += period;
+    }
+}
+
+static void apu_run_noise(struct apu *a, u64 stop)
+{
+    struct apu_noise *n = &a->noise;
+    u32 period = noise_table[g_sched.region == REGION_PAL][n->period];
+    u8 volume = apu_noise_volume(n);
+    u8 tap = n->mode ? 6 : 1;
+    while (n->next < stop)
+    {
+        u16 feedback = (n->lfsr ^ (n->lfsr >> tap)) & 1;
+        n->lfsr = (n->lfsr >> 1) | (feedback << 14);
+        apu_output(a, APU_NOISE, (n->lfsr & 1) ? 0 : volume, n->next);
+        n->next += period;
+    }
+}
+
+static void apu_run_dmc(struct apu *a, u64 stop)
+{
+    struct apu_dmc *d = &a->dmc;
+    u32 period = dmc_table[g_sched.region == REGION_PAL][d->rate];
+    while (d->next < stop)
+    {
+        if(!d->silence)
+        {
+            if(d->shift & 1)
+                d->level += d->level <= 125 ? 2 : 0;
+            else
+                d->level -= d->level >= 2 ? 2 : 0;
+            apu_output(a, APU_DMC, d->level, d->next);
+        }
+        d->shift >>= 1;
+        if(--d->bits == 0)
+        {
+            d->bits = 8;
+            d->silence = !d->buffer_full;
+            d->shift = d->buffer;
+            d->buffer_full = 0;
+        }
+        d->next += period;
+    }
+}
+#pragma endregion
+
+#pragma region "帧计数器"
+static void apu_clock_envelope(struct apu_envelope *env)
+{
+    if(env->start)
+    {
+        env->start = 0;
+        env->decay = 15;
+        env->divider = env->period;
+    }
+    else if(env->divider > 0)
+    {
+        env->divider--;
+    }
+    else
+    {
+        env->divider = env->period;
+        if(env->decay > 0)
+            env->decay--;
+        else if(env->loop)
+            env->decay = 15;
+    }
+}
+
+static void apu_clock_quarter(struct apu *a)
+{
+    struct apu_triangle *t = &a->triangle;
+    apu_clock_envelope(&a->pulse[0].env);
+    apu_clock_envelope(&a->pulse[1].env);
+    apu_clock_envelope(&a->noise.env);
+    if(t->linear_reload)
+        t->linear = t->linear_period;
+    else if(t->linear > 0)
+        t->linear--;
+    if(!t->control)
+        t->linear_reload = 0;
+}
+
+static void apu_clock_half(struct apu *a)
+{
+    for (int ch = APU_PULSE1; ch <= APU_PULSE2; ch++)
+    {
+        struct apu_pulse *p = &a->pulse[ch];
+        if(p->length > 0 && !p->env.loop)
+            p->length--;
+        if(p->sweep_divider == 0 && p->sweep_enable && p->sweep_shift > 0 && !apu_pulse_muted(p, ch))
+            p->timer = apu_sweep_target(p, ch);
+        if(p->sweep_divider == 0 || p->sweep_reload)
+        {
+            p->sweep_divider = p->sweep_period;
+            p->sweep_reload = 0;
+        }
+        else
+        {
+            p->sweep_divider--;
+        }
+    }
+    if(a->triangle.length > 0 && !a->triangle.control)
+        a->triangle.length--;
+    if(a->noise.length > 0 && !a->noise.env.loop)
+        a->noise.length--;
+}
+
+/**
+ * @brief  帧计数器第 step 步相对序列起点的 CPU 周期
+ * @param  mode 0: 4 步, 1: 5 步
+ * @param  step 步序号，等于步数时为序列长度
+ * @retval CPU 周期数
+ * @note 按四分之一帧等距排列，与实际时刻相差不超过 4 个周期。
+ */
+static u64 apu_frame_offset(u8 mode, u8 step)
+{
+    u64 quarter = g_sched.timing->apu_quarter;
+    u8 last = mode ? 4 : 3;
+    u64 offset = quarter * (MIN(step, last) + 1) + (mode == 0 && step >= 3);
+    return step > last ? offset + 1 : offset;
+}
+
+static void apu_frame_clock(struct apu *a)
+{
+    u8 step = a->frame_step;
+    u8 steps = a->frame_mode ? 5 : 4;
+    if(step != 3 || !a->frame_mode)
+        apu_clock_quarter(a);
+    if(step == 1 || step == steps - 1)
+        apu_clock_half(a);
+    if(step == 3 && !a->frame_mode && !a->frame_inhibit)
+    {
+        a->frame_irq = 1;
+        cpu_irq(CPU_IRQ_APU, 1);
+    }
+    if(++a->frame_step == steps)
+    {
+        a->frame_step = 0;
+        a->frame_start += apu_frame_offset(a->frame_mode, steps);
+    }
+    a->frame_next = a->frame_start + apu_frame_offset(a->frame_mode, a->frame_step);
+    apu_refresh(a);
+}
+#pragma endregion
+
+#pragma region "追赶"
+/**
+ * @brief  APU 追赶到指定 CPU 周期
+ * @param  a APU
+ * @param  end 目标 CPU 周期
+ * @retval 无
+ * @note 以帧计数器的步为边界分段，段内各声道独立运行。帧计数器与各声道的定时器始终运行，
+ *       长度计数器、$4015 状态与中断在关闭音频时保持正确，重新开启时相位连续。
+ */
+static void apu_run(struct apu *a, u64 end)
+{
+    while (a->cycle < end)
+    {
+        u64 stop = MIN(end, a->frame_next);
+        apu_run_pulse(a, APU_PULSE1, stop);
+        apu_run_pulse(a, APU_PULSE2, stop);
+        apu_run_triangle(a, stop);
+        apu_run_noise(a, stop);
+        apu_run_dmc(a, stop);
+        a->cycle = stop;
+        if(stop == a->frame_next)
+            apu_frame_clock(a);
+    }
+    /* 扩展音源不受帧计数器影响，整段交给芯片 */
+    for (int i = 0; i < APU_EXPANSION_MAX; i++)
+    {
+        struct apu_expansion *e = &a->expansion[i];
+        if(e->run == NULL || e->cycle >= end)
+            continue;
+        e->run(e->chip, e->cycle, end);
+        e->cycle = end;
+    }
+}
+
+static void apu_sync(u64 until)
+{
+    apu_run(&__apu, until / g_sched.timing->cpu_div);
+}
+
+/**
+ * @brief  预测帧中断与 DMC 读取的时刻并调度事件
+ * @param  a APU
+ * @retval 无
+ * @note APU 平时不运行，事件保证帧中断按时产生、DMC 读取按时占用 CPU。
+ */
+static void apu_update_events(struct apu *a)
+{
+    struct apu_dmc *d = &a->dmc;
+    u32 period = dmc_table[g_sched.region == REGION_PAL][d->rate];
+
+    if(!a->frame_mode && !a->frame_inhibit)
+        sched_event_reschedule(apu_irq_event, (a->frame_start + apu_frame_offset(0, 3)) * g_sched.timing->cpu_div);
+    else
+        sched_event_cancel(apu_irq_event);
+
+    /* 缓冲在移位寄存器下一次清空时被取走，该时钟处理完后读取 */
+    if(d->bytes == 0)
+        sched_event_cancel(apu_dmc_event);
+    else if(!d->buffer_full)
+        sched_event_reschedule(apu_dmc_event, a->cycle * g_sched.timing->cpu_div);
+    else
+        sched_event_reschedule(apu_dmc_event, (d->next + (d->bits - 1) * period + 1) * g_sched.timing->cpu_div);
+}
+
+static void apu_irq_fire(u64 when)
+{
+    apu_sync(when);
+    apu_update_events(&__apu);
+}
+
+/**
+ * @brief  DMC 读取事件：读取下一个采样字节
+ * @param  when 事件时刻
+ * @retval 无
+ * @note 经直接读取路径访问 PRG，CPU 被占用的周期在下一批次开始时扣除。
+ *       最后一个字节读取后循环或产生中断。
+ */
+static void apu_dmc_fire(u64 when)
+{
+    struct apu *a = &__apu;
+    struct apu_dmc *d = &a->dmc;
+
+    apu_sync(when);
+    if(!d->buffer_full && d->bytes > 0)
+    {
+        d->buffer = bus_read_direct(d->addr);
+        d->buffer_full = 1;
+        d->addr = d->addr == 0xFFFF ? 0x8000 : d->addr + 1;
+        cpu_stall(APU_DMC_STALL);
+        if(--d->bytes == 0 && d->loop)
+        {
+            d->addr = d->start;
+            d->bytes = d->size;
+        }
+        else if(d->bytes == 0 && d->irq_enable)
+        {
+            a->dmc_irq = 1;
+            cpu_irq(CPU_IRQ_DMC, 1);
+        }
+    }
+    apu_update_events(a);
+}
+#pragma endregion
+
+#pragma region "总线"
+static void apu_write_envelope(struct apu_envelope *env, u8 data)
+{
+    env->loop = (data >> 5) & 1;
+    env->constant = (data >> 4) & 1;
+    env->period = data & 0x0F;
+}
+
+static void apu_write_pulse(struct apu *a, enum apu_channel ch, u8 reg, u8 data)
+{
+    struct apu_pulse *p = &a->pulse[ch];
+    switch (reg)
+    {
+    case 0:
+        p->duty = data >> 6;
+        apu_write_envelope(&p->env, data);
+        break;
+    case 1:
+        p->sweep_enable = data >> 7;
+        p->sweep_period = (data >> 4) & 7;
+        p->sweep_negate = (data >> 3) & 1;
+        p->sweep_shift = data & 7;
+        p->sweep_reload = 1;
+        break;
+    case 2:
+        p->timer = (p->timer & 0x700) | data;
+        break;
+    case 3:
+        p->timer = (p->timer & 0xFF) | ((data & 7) << 8);
+        if(a->enabled & (1 << ch))
+            p->length = length_table[data >> 3];
+        p->step = 0;
+        p->env.start = 1;
+        break;
+    }
+}
+
+static void apu_write_triangle(struct apu *a, u8 reg, u8 data)
+{
+    struct apu_triangle *t = &a->triangle;
+    switch (reg)
+    {
+    case 0:
+        t->control = data >> 7;
+        t->linear_period = data & 0x7F;
+        break;
+    case 2:
+        t->timer = (t->timer & 0x700) | data;
+        break;
+    case 3:
+        t->timer = (t->timer & 0xFF) | ((data & 7) << 8);
+        if(a->enabled & (1 << APU_TRIANGLE))
+            t->length = length_table[data >> 3];
+        t->linear_reload = 1;
+        break;
+    }
+}
+
+static void apu_write_noise(struct apu *a, u8 reg, u8 data)
+{
+    struct apu_noise *n = &a->noise;
+    switch (reg)
+    {
+    case 0:
+        apu_write_envelope(&n->env, data);
+        break;
+    case 2:
+        n->mode = data >> 7;
+        n->period = data & 0x0F;
+        break;
+    case 3:
+        if(a->enabled & (1 << APU_NOISE))
+            n->length = length_table[data >> 3];
+        n->env.start = 1;
+        break;
+    }
+}
+
+static void apu_write_dmc(struct apu *a, u8 reg, u8 data)
+{
+    struct apu_dmc *d = &a->dmc;
+    switch (reg)
+    {
+    case 0:
+        d->irq_enable = data >> 7;
+        d->loop = (data >> 6) & 1;
+        d->rate = data & 0x0F;
+        if(!d->irq_enable)
+        {
+            a->dmc_irq = 0;
+            cpu_irq(CPU_IRQ_DMC, 0);
+        }
+        break;
+    case 1:
+        d->level = data & 0x7F;
+        break;
+    case 2:
+        d->start = 0xC000 | (data << 6);
+        break;
+    case 3:
+        d->size = (data << 4) + 1;
+        break;
+    }
+}
+
+static void apu_write_status(struct apu *a, u8 data)
+{
+    struct apu_dmc *d = &a->dmc;
+    a->enabled = data & 0x1F;
+    if(!(data & 0x01))
+        a->pulse[0].length = 0;
+    if(!(data & 0x02))
+        a->pulse[1].length = 0;
+    if(!(data & 0x04))
+        a->triangle.length = 0;
+    if(!(data & 0x08))
+        a->noise.length = 0;
+    if(!(data & 0x10))
+    {
+        d->bytes = 0;
+    }
+    else if(d->bytes == 0)
+    {
+        d->addr = d->start;
+        d->bytes = d->size;
+    }
+    a->dmc_irq = 0;
+    cpu_irq(CPU_IRQ_DMC, 0);
+}
+
+/**
+ * @brief  写入帧计数器
+ * @param  a APU
+ * @param  data 写入的数据
+ * @retval 无
+ * @note 序列立即从头开始（硬件延迟 3-4 个周期），5 步模式立即产生一次四分之一帧与半帧时钟。
+ */
+static void apu_write_frame(struct apu *a, u8 data)
+{
+    a->frame_mode = data >> 7;
+    a->frame_inhibit = (data >> 6) & 1;
+    if(a->frame_inhibit)
+    {
+        a->frame_irq = 0;
+        cpu_irq(CPU_IRQ_APU, 0);
+    }
+    a->frame_step = 0;
+    a->frame_start = a->cycle;
+    a->frame_next = a->frame_start + apu_frame_offset(a->frame_mode, 0);
+    if(a->frame_mode)
+    {
+        apu_clock_quarter(a);
+        apu_clock_half(a);
+    }
+}
+
+static u8 apu_read(u16 addr)
+{
+    struct apu *a = &__apu;
+    u8 data;
+    if(addr != APU_REG_STATUS)
+        return APU_OPEN_BUS;
+
+    sched_sync(apu_sched_id);
+    data = a->dmc_irq << 7 | a->frame_irq << 6 | (a->dmc.bytes > 0) << 4;
+    data |= (a->noise.length > 0) << 3 | (a->triangle.length > 0) << 2;
+    data |= (a->pulse[1].length > 0) << 1 | (a->pulse[0].length > 0);
+    a->frame_irq = 0;
+    cpu_irq(CPU_IRQ_APU, 0);
+    return data;
+}
+
+static void apu_write(u16 addr, u8 data)
+{
+    struct apu *a = &__apu;
+    if(addr == APU_REG_OAM_DMA)
+    {
+        ppu_oam_dma(data);
+        return;
+    }
+    if(addr == APU_REG_JOY1)
+        return;
+
+    sched_sync(apu_sched_id);
+    if(addr < APU_REG_PULSE2)
+        apu_write_pulse(a, APU_PULSE1, addr & 3, data);
+    else if(addr < APU_REG_TRIANGLE)
+        apu_write_pulse(a, APU_PULSE2, addr & 3, data);
+    else if(addr < APU_REG_NOISE)
+        apu_write_triangle(a, addr & 3, data);
+    else if(addr < APU_REG_DMC)
+        apu_write_noise(a, addr & 3, data);
+    else if(addr < APU_REG_OAM_DMA)
+        apu_write_dmc(a, addr & 3, data);
+    else if(addr == APU_REG_STATUS)
+        apu_write_status(a, data);
+    else if(addr == APU_REG_FRAME)
+        apu_write_frame(a, data);
+    apu_refresh(a);
+    apu_update_events(a);
+}
+#pragma endregion
+
+#pragma region "APU"
+static char apu_name[] = "NES_APU_2A03";
+static char apu_irq_name[] = "APU irq";
+static char apu_dmc_name[] = "APU DMC fetch";
+
+/**
+ * @brief  设置输出采样率
+ * @param  rate 采样率，不超过 \c BLIP_MAX_RATE
+ * @retval 无
+ * @note 尚未读取的采样被丢弃。
+ */
+void apu_set_sample_rate(double rate)
+{
+    struct apu *a = &__apu;
+    double clock = (double)g_sched.timing->master_hz / g_sched.timing->cpu_div;
+    a->rate = rate;
+    blip_set_rates(&a->blip, clock, rate);
+    for (int i = 0; a->capture && i < APU_CAPTURE_NUM; i++)
+        blip_set_rates(&a->capture_blip[i], clock, rate);
+    a->frame_base = a->cycle;
+}
+
+/**
+ * @brief  开启或关闭音频合成
+ * @param  enable 0 表示关闭
+ * @retval 无
+ * @note 关闭后不混音、不输出采样，各声道的定时器、帧计数器、长度计数器、DMC 读取与中断照常模拟。
+ *       关闭前已合成的部分仍可读取；重新开启时相位连续，合成缓冲从关闭时的电平阶跃到当前电平。
+ */
+void apu_set_audio(int enable)
+{
+    struct apu *a = &__apu;
+    enable = enable != 0;
+    if(a->audio == enable)
+        return;
+    if(apu_sched_id != RET_ERR)
+        sched_sync(apu_sched_id);
+    a->audio = enable;
+    int expansion_amp = 0;
+    for (int i = 0; i < APU_EXPANSION_MAX; i++)
+        expansion_amp += a->expansion[i].amp;
+    u32 when = a->cycle - a->frame_base;
+    if(!enable)
+    {
+        /* 结束本帧已合成的部分，缓冲保持关闭时的电平 */
+        blip_end_frame(&a->blip, when);
+        for (int i = 0; a->capture && i < APU_CAPTURE_NUM; i++)
+            blip_end_frame(&a->capture_blip[i], when);
+        a->frame_base = a->cycle;
+        a->expansion_amp = expansion_amp;
+        return;
+    }
+    u8 level[APU_CH_NUM];
+    apu_levels(a, level);
+    int amp = apu_mix(level);
+    blip_add_delta(&a->blip, when, amp + expansion_amp - a->amp - a->expansion_amp);
+    for (int ch = 0; a->capture && ch < APU_CH_NUM; ch++)
+        blip_add_delta(&a->capture_blip[ch], when, apu_solo(ch, level[ch]) - apu_solo(ch, a->level[ch]));
+    if(a->capture)
+        blip_add_delta(&a->capture_blip[APU_CAPTURE_EXPANSION], when, expansion_amp - a->expansion_amp);
+    memcpy(a->level, level, sizeof(level));
+    a->amp = amp;
+}
+
+/**
+ * @brief  查询是否合成音频
+ * @retval 1: 合成, 0: 只模拟状态
+ */
+int apu_audio(void)
+{
+    return __apu.audio;
+}
+
+/**
+ * @brief  开启或关闭分声道采集
+ * @param  enable 0 表示关闭
+ * @retval 无
+ * @note 开启后同一次合成中每个声道另外写入独立的缓冲，不增加模拟，
+ *       关闭时只多一次判断。本帧已合成的部分不计入，从下一帧开始完整。
+ */
+void apu_set_capture(int enable)
+{
+    struct apu *a = &__apu;
+    enable = enable != 0;
+    if(a->capture == enable)
+        return;
+    if(apu_sched_id != RET_ERR)
+        sched_sync(apu_sched_id);
+    a->capture = enable;
+    double clock = (double)g_sched.timing->master_hz / g_sched.timing->cpu_div;
+    for (int i = 0; enable && i < APU_CAPTURE_NUM; i++)
+    {
+        blip_set_rates(&a->capture_blip[i], clock, a->rate);
+        /* 与主缓冲的采样边界对齐，每帧产生的采样数相同 */
+        a->capture_blip[i].offset = a->blip.offset & (((u64)1 << BLIP_FRAC_BITS) - 1);
+    }
+}
+
+/**
+ * @brief  查询是否分声道采集
+ * @retval 1: 采集, 0: 不采集
+ */
+int apu_capture(void)
+{
+    return __apu.capture;
+}
+
+/**
+ * @brief  获取输出采样率
+ * @retval 采样率
+ */
+double apu_sample_rate(void)
+{
+    return __apu.rate;
+}
+
+/**
+ * @brief  结束一帧音频
+ * @retval 无
+ * @note 在 \c sched_run_frame 之后调用，本帧的采样随后可以读取。
+ */
+void apu_end_frame(void)
+{
+    struct apu *a = &__apu;
+    sched_sync(apu_sched_id);
+    if(a->audio)
+        blip_end_frame(&a->blip, a->cycle - a->frame_base);
+    for (int i = 0; a->audio && a->capture && i < APU_CAPTURE_NUM; i++)
+    {
+        struct blip *b = &a->capture_blip[i];
+        blip_read_samples(b, NULL, blip_samples_avail(b), 0);
+        blip_end_frame(b, a->cycle - a->frame_base);
+    }
+    a->frame_base = a->cycle;
+}
+
+/**
+ * @brief  查询可读取的采样数
+ * @retval 采样数
+ */
+unsigned apu_samples_avail(void)
+{
+    return blip_samples_avail(&__apu.blip);
+}
+
+/**
+ * @brief  读取采样
+ * @param  out 输出，NULL 表示丢弃
+ * @param  count 最多读取的采样数
+ * @param  stereo 非 0 时输出左右声道交错的采样
+ * @retval 实际读取的采样数
+ */
+unsigned apu_read_samples(s16 *out, unsigned count, int stereo)
+{
+    return blip_read_samples(&__apu.blip, out, count, stereo);
+}
+
+/**
+ * @brief  挂接扩展音源
+ * @param  name 芯片名称
+ * @param  run 追赶回调，在 [from, to) 内运行芯片
+ * @param  chip 传给回调的芯片实例
+ * @retval expansion_id，\c RET_ERR 表示已满
+ * @note 由 mapper 在 \c apu_init 之后调用，芯片从当前周期开始运行，初始输出为 0。
+ */
+expansion_id apu_expansion_register(char *name, expansion_fn run, void *chip)
+{
+    struct apu *a = &__apu;
+    for (int i = 0; i < APU_EXPANSION_MAX; i++)
+    {
+        struct apu_expansion *e = &a->expansion[i];
+        if(e->run != NULL)
+            continue;
+        if(apu_sched_id != RET_ERR)
+            sched_sync(apu_sched_id);
+        e->name = name;
+        e->run = run;
+        e->chip = chip;
+        e->cycle = a->cycle;
+        e->amp = 0;
+        return i;
+    }
+    return RET_ERR;
+}
+
+/**
+ * @brief  卸下扩展音源
+ * @param  id \c apu_expansion_register 返回的 expansion_id
+ * @retval 无
+ * @note 输出回到 0，非法的 expansion_id 将无任何效果。
+ */
+void apu_expansion_remove(expansion_id id)
+{
+    struct apu *a = &__apu;
+    if(id < 0 || id >= APU_EXPANSION_MAX || a->expansion[id].run == NULL)
+        return;
+    if(apu_sched_id != RET_ERR)
+        sched_sync(apu_sched_id);
+    apu_expansion_output(id, 0, a->cycle);
+    memset(&a->expansion[id], 0, sizeof(a->expansion[id]));
+}
+
+/**
+ * @brief  更新扩展音源的输出
+ * @param  id expansion_id
+ * @param  amp 新输出，单位为输出采样值，与 2A03 线性叠加
+ * @param  when 变化时刻（CPU 周期），只能在 run 回调的区间内
+ * @retval 无
+ * @note 与 \c apu_output 相同，不变时没有开销；关闭音频时只记录输出。
+ */
+void apu_expansion_output(expansion_id id, int amp, u64 when)
+{
+    struct apu *a = &__apu;
+    struct apu_expansion *e = &a->expansion[id];
+    if(e->amp == amp)
+        return;
+    if(a->audio)
+        blip_add_delta(&a->blip, when - a->frame_base, amp - e->amp);
+    if(a->audio && a->capture)
+        blip_add_delta(&a->capture_blip[APU_CAPTURE_EXPANSION], when - a->frame_base, amp - e->amp);
+    e->amp = amp;
+}
+
+/**
+ * @brief  将 APU 与扩展音源追赶到当前时刻
+ * @retval 无
+ * @note mapper 访问芯片寄存器前调用。
+ */
+void apu_expansion_sync(void)
+{
+    sched_sync(apu_sched_id);
+}
+
+/**
+ * @brief  读取分声道采集的采样
+ * @param  ch 声道，\c APU_CAPTURE_EXPANSION 为全部扩展音源之和
+ * @param  out 单声道输出，NULL 表示丢弃
+ * @param  count 最多读取的采样数
+ * @retval 实际读取的采样数，每帧与主输出新产生的采样数相同
+ * @note 在 \c apu_end_frame 之后、下一次 \c apu_end_frame 之前读取，未读的采样随后被丢弃。
+ */
+unsigned apu_read_capture(unsigned ch, s16 *out, unsigned count)
+{
+    struct apu *a = &__apu;
+    if(!a->capture || ch >= APU_CAPTURE_NUM)
+        return 0;
+    return blip_read_samples(&a->capture_blip[ch], out, count, 0);
+}
+
+/**
+ * @brief  APU复位
+ * @retval 无
+ * @note 需在 \c sched_reset 之后调用，切换制式后时钟频率随之更新。
+ */
+void apu_reset(void)
+{
+    struct apu *a = &__apu;
+    double rate = a->rate;
+
+    memset(a, 0, offsetof(struct apu, rate));
+    a->noise.lfsr = 1;
+    a->dmc.bits = 8;
+    a->dmc.silence = 1;
+    a->cycle = a->frame_base = g_sched.clock / g_sched.timing->cpu_div;
+    a->frame_start = a->cycle;
+    a->frame_next = a->frame_start + apu_frame_offset(0, 0);
+    for (int i = 0; i < 2; i++)
+        a->pulse[i].next = a->cycle;
+    a->triangle.next = a->noise.next = a->dmc.next = a->cycle;
+    /* 上电时三角波停在第一步，以此为静音电平，避免输出起始阶跃 */
+    apu_levels(a, a->level);
+    a->amp = apu_mix(a->level);
+    for (int i = 0; i < APU_EXPANSION_MAX; i++)
+        a->expansion[i].cycle = a->cycle;
+    cpu_irq(CPU_IRQ_APU | CPU_IRQ_DMC, 0);
+    apu_set_sample_rate(rate);
+    apu_update_events(a);
+}
+
+/**
+ * @brief  APU初始化
+ * @retval 返回 \c RET_ERR 表示失败，其他表示成功
+ * @note $4014 的 OAM DMA 转交 PPU。
+ */
+dev_id apu_init(void)
+{
+    static dev_id apu_id = RET_ERR;
+    struct apu *a = &__apu;
+
+    if(apu_id != RET_ERR)
+        bus_remove(apu_id);
+    sched_remove(apu_sched_id);
+    sched_event_remove(apu_irq_event);
+    sched_event_remove(apu_dmc_event);
+    apu_sched_id = RET_ERR;
+
+    blip_init();
+    apu_build_mixer();
+    a->rate = APU_SAMPLE_RATE;
+    a->audio = 1;
+    a->capture = 0;
+    memset(a->expansion, 0, sizeof(a->expansion));
+    apu_id = bus_register(apu_name, APU_MAP_BASE, APU_MAP_SIZE, apu_read, apu_write);
+    apu_sched_id = sched_register(apu_name, apu_sync);
+    apu_irq_event = sched_event_register(apu_irq_name, apu_irq_fire);
+    apu_dmc_event = sched_event_register(apu_dmc_name, apu_dmc_fire);
+    if(apu_id == RET_ERR || apu_sched_id == RET_ERR || apu_irq_event == RET_ERR || apu_dmc_event == RET_ERR)
+        return RET_ERR;
+
+    apu_reset();
+    return apu_id;
+}
+#pragma endregion
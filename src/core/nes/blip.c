@@ -0,0 +1,153 @@
+#include <math.h>
+#include <string.h>
+#include "log.h"
+#include "core/nes/blip.h"
+
+#define BLIP_PHASE_BITS 5
+#define BLIP_PHASES (1 << BLIP_PHASE_BITS)  /* 阶跃位置在一个采样内的量化级数 */
+#define BLIP_UNIT_BITS 14                   /* 核系数的小数位数，每行之和为 1 */
+#define BLIP_BASS_SHIFT 9                   /* 积分器泄漏，即输出端高通，约 14Hz@44.1kHz */
+#define BLIP_CUTOFF 0.9                     /* 低通截止频率，相对奈奎斯特频率 */
+
+/* 冲激核：[阶跃位置的小数部分][抽头]，第 k 个抽头对应输出采样 idx + k - (BLIP_WIDTH / 2 - 1) */
+static s16 blip_kernel[BLIP_PHASES][BLIP_WIDTH];
+
+/**
+ * @brief  生成冲激核
+ * @retval 无
+ * @note Blackman 窗 sinc，每行单独归一化，保证积分后阶跃高度准确、不产生直流漂移。
+ */
+void blip_init(void)
+{
+    for (unsigned p = 0; p < BLIP_PHASES; p++)
+    {
+        double tap[BLIP_WIDTH], sum = 0;
+        for (int k = 0; k < BLIP_WIDTH; k++)
+        {
+            double t = k - (BLIP_WIDTH / 2 - 1) - (double)p / BLIP_PHASES;
+            double x = M_PI * BLIP_CUTOFF * t;
+            double sinc = x == 0 ? 1 : sin(x) / x;
+            double w = 0.42 + 0.5 * cos(2 * M_PI * t / BLIP_WIDTH) + 0.08 * cos(4 * M_PI * t / BLIP_WIDTH);
+            tap[k] = sinc * w;
+            sum += tap[k];
+        }
+
+        int total = 0, peak = 0;
+        for (int k = 0; k < BLIP_WIDTH; k++)
+        {
+            blip_kernel[p][k] = (s16)lrint(tap[k] * (1 << BLIP_UNIT_BITS) / sum);
+            total += blip_kernel[p][k];
+            if(blip_kernel[p][k] > blip_kernel[p][peak])
+                peak = k;
+        }
+        blip_kernel[p][peak] += (1 << BLIP_UNIT_BITS) - total;
+    }
+}
+
+/**
+ * @brief  设置时钟频率与输出采样率
+ * @param  b 缓冲
+ * @param  clock_rate 输入时钟频率，即 \c blip_add_delta 时刻的单位
+ * @param  sample_rate 输出采样率
+ * @retval 无
+ * @note 缓冲被清空。
+ */
+void blip_set_rates(struct blip *b, double clock_rate, double sample_rate)
+{
+    LOG_ASSERT(sample_rate > 0 && sample_rate <= BLIP_MAX_RATE && sample_rate < clock_rate);
+    b->factor = (u64)(sample_rate / clock_rate * ((u64)1 << BLIP_FRAC_BITS) + 0.5);
+    blip_clear(b);
+}
+
+/**
+ * @brief  清空缓冲
+ * @param  b 缓冲
+ * @retval 无
+ */
+void blip_clear(struct blip *b)
+{
+    b->offset = 0;
+    b->integrator = 0;
+    memset(b->buf, 0, sizeof(b->buf));
+}
+
+/**
+ * @brief  在指定时刻加入一个阶跃
+ * @param  b 缓冲
+ * @param  clock 相对帧起点的时钟数
+ * @param  delta 电平变化量，单位为输出采样值
+ * @retval 无
+ */
+void blip_add_delta(struct blip *b, u32 clock, int delta)
+{
+    u64 pos = b->offset + clock * b->factor;
+    u32 idx = pos >> BLIP_FRAC_BITS;
+    u32 phase = (pos >> (BLIP_FRAC_BITS - BLIP_PHASE_BITS)) & (BLIP_PHASES - 1);
+    LOG_ASSERT(idx < BLIP_MAX_FRAME * 2);
+
+    s32 *out = b->buf + idx;
+    const s16 *k = blip_kernel[phase];
+    for (int i = 0; i < BLIP_WIDTH; i++)
+        out[i] += k[i] * delta;
+}
+
+/**
+ * @brief  结束一帧
+ * @param  b 缓冲
+ * @param  clocks 本帧的时钟数
+ * @retval 无
+ * @note 之后的时刻相对新的帧起点，本帧的采样可以读取。
+ */
+void blip_end_frame(struct blip *b, u32 clocks)
+{
+    b->offset += clocks * b->factor;
+    LOG_ASSERT(blip_samples_avail(b) <= BLIP_MAX_FRAME * 2);
+}
+
+/**
+ * @brief  查询可读取的采样数
+ * @param  b 缓冲
+ * @retval 采样数
+ */
+unsigned blip_samples_avail(const struct blip *b)
+{
+    return b->offset >> BLIP_FRAC_BITS;
+}
+
+/**
+ * @brief  读取采样
+ * @param  b 缓冲
+ * @param  out 输出，NULL 表示丢弃
+ * @param  count 最多读取的采样数
+ * @param  stereo 非 0 时每个采样写入左右两个声道
+ * @retval 实际读取的采样数
+ */
+unsigned blip_read_samples(struct blip *b, s16 *out, unsigned count, int stereo)
+{
+    unsigned avail = blip_samples_avail(b);
+    if(count > avail)
+        count = avail;
+
+    s32 sum = b->integrator;
+    for (unsigned i = 0; i < count; i++)
+    {
+        s32 s = sum >> BLIP_UNIT_BITS;
+        sum += b->buf[i];
+        sum -= s * (1 << (BLIP_UNIT_BITS - BLIP_BASS_SHIFT));    /* s 可为负，不能左移 */
+        if(s > INT16_MAX)
+            s = INT16_MAX;
+        else if(s < INT16_MIN)
+            s = INT16_MIN;
+        if(out && stereo)
+            out[i * 2] = out[i * 2 + 1] = s;
+        else if(out)
+            out[i] = s;
+    }
+    b->integrator = sum;
+
+    unsigned remain = avail - count;
+    memmove(b->buf, b->buf + count, (remain + BLIP_WIDTH) * sizeof(b->buf[0]));
+    memset(b->buf + remain + BLIP_WIDTH, 0, count * sizeof(b->buf[0]));
+    b->offset -= (u64)count << BLIP_FRAC_BITS;
+    return count;
+}
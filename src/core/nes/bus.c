@@ -13,6 +13,9 @@ static struct device
     read_fn read;
     write_fn write;
 } dev[BUS_DEV_MAX_NUM];
+static u8 open_bus;
+/* 可直接读取的存储页，DMA 等无副作用的读取不经过设备查找 */
+static const u8 *direct[0x10000 / BUS_PAGE_SIZE];
 /* TODO 或许可以使用动态数组或者链表 */
 
 /**
@@ -42,15 +45,21 @@ static dev_id bus_find_dev(u16 addr)
  * @param  map_addr 映射地址
  * @param  size 映射大小
  * @retval \c RET_ERR: 非法, \c RET_OK: 合法
- * @note 
+ * @note 按区间判断重叠，以 32 位计算结束地址，映射到 $FFFF 的设备不会回绕到 $0000。
  */
 static int bus_check_map(u16 map_addr, u16 size)
 {
-    if (bus_find_dev(map_addr) < 0 
-        && bus_find_dev(map_addr + size / 2) < 0 
-        && bus_find_dev(size + map_addr) < 0)
-        return RET_OK;
-    return RET_ERR;
+    u32 end = (u32)map_addr + size;
+    if(size == 0 || end > 0x10000)
+        return RET_ERR;
+    for (size_t i = 0; i < BUS_DEV_MAX_NUM; i++)
+    {
+        if(dev[i].name == NULL)
+            continue;
+        if(map_addr < (u32)dev[i].map_addr + dev[i].size && dev[i].map_addr < end)
+            return RET_ERR;
+    }
+    return RET_OK;
 }
 
 /**
@@ -111,20 +120,22 @@ void bus_remove(dev_id id)
 {
     if(id < 0 || id >= BUS_DEV_MAX_NUM)
         return;
-    memset(dev + id, 0, sizeof(dev));
+    memset(dev + id, 0, sizeof(dev[0]));
 }
 
 /**
  * @brief  读取总线对应地址数据
  * @param  addr 总线地址
  * @retval 读取的数据
- * @note 若读取非法地址进程将退出。
+ * @note 读取未映射的地址返回总线上一次的数据（open bus）。
  */
 u8 bus_read(u16 addr)
 {
     dev_id id = bus_find_dev(addr);
-    LOG_ASSERT(id != RET_ERR);
-    return dev[id].read(addr - dev[id].map_addr);
+    if(id == RET_ERR)
+        return open_bus;
+    open_bus = dev[id].read(addr - dev[id].map_addr);
+    return open_bus;
 }
 
 /**
@@ -132,11 +143,43 @@ u8 bus_read(u16 addr)
  * @param  addr 总线地址
  * @param  data 写入的数据
  * @retval 无
- * @note 若写入非法地址进程将退出。
+ * @note 写入未映射的地址将被忽略。
  */
 void bus_write(u16 addr, u8 data)
 {
     dev_id id = bus_find_dev(addr);
-    LOG_ASSERT(id != RET_ERR);
+    open_bus = data;
+    if(id == RET_ERR)
+        return;
     dev[id].write(addr - dev[id].map_addr, data);
-}
\ No newline at end of file
+}
+
+/**
+ * @brief  登记可直接读取的存储
+ * @param  addr 总线地址，按页对齐
+ * @param  len 长度，按页对齐
+ * @param  mem 存储，NULL 表示取消登记
+ * @retval 无
+ * @note 只用于读取没有副作用的存储（RAM、ROM），写入仍经过设备。镜像地址需分别登记。
+ */
+void bus_map_direct(u16 addr, u32 len, const u8 *mem)
+{
+    LOG_ASSERT(addr % BUS_PAGE_SIZE == 0 && len % BUS_PAGE_SIZE == 0 && addr + len <= 0x10000);
+    for (u32 offset = 0; offset < len; offset += BUS_PAGE_SIZE)
+        direct[(addr + offset) / BUS_PAGE_SIZE] = mem ? mem + offset : NULL;
+}
+
+/**
+ * @brief  DMA 读取
+ * @param  addr 总线地址
+ * @retval 读取的数据
+ * @note 已登记的存储页直接读取，其余地址与 \c bus_read 相同。
+ */
+u8 bus_read_direct(u16 addr)
+{
+    const u8 *page = direct[addr / BUS_PAGE_SIZE];
+    if(page == NULL)
+        return bus_read(addr);
+    open_bus = page[addr % BUS_PAGE_SIZE];
+    return open_bus;
+}
@@ -0,0 +1,543 @@
+#include <string.h>
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+#include "log.h"
+#include "core/nes/bus.h"
+#include "core/nes/cart.h"
+#include "core/nes/chr.h"
+#include "core/nes/cpu.h"
+#include "core/nes/n163.h"
+#include "core/nes/ppu.h"
+#include "core/nes/sched.h"
+
+#define CART_PRG_UNIT 0x4000        /* iNES 文件头中 PRG 大小的单位 */
+#define CART_CHR_UNIT 0x2000        /* iNES 文件头中 CHR 大小的单位 */
+#define CART_PRG_BANK_SIZE 0x2000   /* CPU 地址空间中 PRG 的映射粒度 */
+#define CART_PRG_BANK_NUM (CART_MAP_SIZE / CART_PRG_BANK_SIZE)
+#define CART_PRG_RAM_BASE 0x6000
+
+#define CART_N163_MAPPER 19
+#define CART_N163_PRG_MAX (64 * CART_PRG_BANK_SIZE)    /* 6 位 PRG bank 号 */
+#define CART_N163_CHR_MAX (256 * CHR_BANK_SIZE)        /* 8 位 CHR bank 号 */
+#define CART_N163_SOUND_BASE 0x4800
+#define CART_N163_SOUND_SIZE (CPU_MAP_BASE - CART_N163_SOUND_BASE)    /* $4F00 起被 CPU 调试寄存器占用 */
+#define CART_N163_IRQ_MAX 0x7FFF
+
+static struct cart
+{
+    struct cart_info info;
+    const u8 *image;        /* cart_load_file 映射的文件，NULL 表示数据由调用者持有 */
+    size_t image_size;
+    const u8 *prg[CART_PRG_BANK_NUM];
+    u8 prg_ram[CART_PRG_RAM_SIZE];
+    u8 loaded;
+
+    /* mapper 19：Namco 163 */
+    struct n163 n163;
+    u8 nametable[4];        /* $C000-$D800 写入的值 */
+    u8 irq_enable;
+    u16 irq_counter;        /* irq_base 时刻的计数值 */
+    u64 irq_base;           /* CPU 周期 */
+} __cart;
+
+static char cart_name[] = "Cartridge PRG";
+static char sram_name[] = "Cartridge SRAM";
+static char sound_name[] = "Namco 163 sound";
+static char irq_name[] = "Namco 163 IRQ";
+static dev_id cart_id = RET_ERR;
+static dev_id sram_id = RET_ERR;
+static dev_id sound_id = RET_ERR;
+static event_id irq_event = RET_ERR;
+
+static void n163_map_write(u16 addr, u8 data);
+static u8 n163_irq_read(u16 addr);
+static void n163_irq_write(u16 addr, u8 data);
+
+#pragma region "文件头"
+/**
+ * @brief  计算 NES 2.0 的 ROM 大小
+ * @param  lsb 文件头中的低字节
+ * @param  msb 高 4 位，0xF 表示指数表示法
+ * @param  unit 大小单位
+ * @retval 字节数，超出 32 位时返回 0
+ * @note 指数表示法为 2^E * (MM * 2 + 1)，lsb 的格式为 EEEEEEMM。
+ */
+static u32 cart_rom_size(u8 lsb, u8 msb, u32 unit)
+{
+    if(msb != 0x0F)
+        return ((u32)msb << 8 | lsb) * unit;
+    u8 exp = lsb >> 2;
+    if(exp > 28)
+        return 0;
+    return ((u32)1 << exp) * ((lsb & 0x03) * 2 + 1);
+}
+
+/**
+ * @brief  计算 NES 2.0 的 RAM 大小
+ * @param  shift 文件头中的 4 位移位数
+ * @retval 字节数，0 表示没有
+ */
+static u32 cart_ram_size(u8 shift)
+{
+    return shift ? 64u << shift : 0;
+}
+
+/**
+ * @brief  解析 iNES / NES 2.0 镜像
+ * @param  info 解析结果，PRG、CHR 指向 data 内部
+ * @param  data 镜像数据
+ * @param  size 镜像大小
+ * @retval \c RET_OK: 成功, \c RET_ERR: 不是合法的镜像
+ * @note 旧式 iNES 文件头第 12-15 字节不为 0 时视为被工具写入了签名，忽略第 7 字节以后的内容。
+ */
+int cart_parse(struct cart_info *info, const u8 *data, size_t size)
+{
+    memset(info, 0, sizeof(*info));
+    if(data == NULL || size < CART_HEADER_SIZE || memcmp(data, "NES\x1A", 4))
+        return RET_ERR;
+
+    u8 flags6 = data[6], flags7 = data[7];
+    info->nes2 = (flags7 & 0x0C) == 0x08;
+    if(!info->nes2 && (data[12] | data[13] | data[14] | data[15]))
+        flags7 = 0;
+
+    info->mapper = (flags6 >> 4) | (flags7 & 0xF0);
+    info->battery = (flags6 >> 1) & 0x01;
+    if(flags6 & 0x08)
+        info->mirror = PPU_MIRROR_FOUR;
+    else
+        info->mirror = (flags6 & 0x01) ? PPU_MIRROR_VERTICAL : PPU_MIRROR_HORIZONTAL;
+
+    if(info->nes2)
+    {
+        static const enum region timing[4] = {REGION_NTSC, REGION_PAL, REGION_NTSC, REGION_DENDY};
+        info->mapper |= (data[8] & 0x0F) << 8;
+        info->submapper = data[8] >> 4;
+        info->prg_size = cart_rom_size(data[4], data[9] & 0x0F, CART_PRG_UNIT);
+        info->chr_size = cart_rom_size(data[5], data[9] >> 4, CART_CHR_UNIT);
+        info->prg_ram_size = cart_ram_size(data[10] & 0x0F) + cart_ram_size(data[10] >> 4);
+        info->chr_ram_size = cart_ram_size(data[11] & 0x0F) + cart_ram_size(data[11] >> 4);
+        info->region = timing[data[12] & 0x03];
+    }
+    else
+    {
+        info->prg_size = data[4] * CART_PRG_UNIT;
+        info->chr_size = data[5] * CART_CHR_UNIT;
+        info->prg_ram_size = (flags7 && data[8]) ? data[8] * 0x2000u : 0x2000u;
+        info->chr_ram_size = info->chr_size ? 0 : CART_CHR_UNIT;
+        info->region = (flags7 && (data[9] & 0x01)) ? REGION_PAL : REGION_NTSC;
+    }
+
+    size_t offset = CART_HEADER_SIZE;
+    if(flags6 & 0x04)
+    {
+        info->trainer = data + offset;
+        offset += CART_TRAINER_SIZE;
+    }
+    if(info->prg_size == 0 || (u64)offset + info->prg_size + info->chr_size > size)
+        return RET_ERR;
+    info->prg = data + offset;
+    info->chr = info->chr_size ? data + offset + info->prg_size : NULL;
+    return RET_OK;
+}
+#pragma endregion
+
+#pragma region "总线"
+static u8 cart_read(u16 addr)
+{
+    return __cart.prg[addr / CART_PRG_BANK_SIZE][addr % CART_PRG_BANK_SIZE];
+}
+
+static void cart_write(u16 addr, u8 data)
+{
+    /* NROM 没有寄存器，写入被忽略 */
+    if(__cart.info.mapper == CART_N163_MAPPER)
+        n163_map_write(CART_MAP_BASE + addr, data);
+}
+
+/**
+ * @brief  读取 $5000-$7FFF
+ * @param  addr 相对 SRAM_MAP_BASE 的地址
+ * @retval $6000 起为 PRG-RAM，之前为 mapper 寄存器，没有寄存器时返回地址高字节近似 open bus
+ */
+static u8 sram_read(u16 addr)
+{
+    if(addr >= CART_PRG_RAM_BASE - SRAM_MAP_BASE)
+        return __cart.prg_ram[addr - (CART_PRG_RAM_BASE - SRAM_MAP_BASE)];
+    if(__cart.info.mapper == CART_N163_MAPPER)
+        return n163_irq_read(SRAM_MAP_BASE + addr);
+    return (SRAM_MAP_BASE + addr) >> 8;
+}
+
+static void sram_write(u16 addr, u8 data)
+{
+    if(addr >= CART_PRG_RAM_BASE - SRAM_MAP_BASE)
+        __cart.prg_ram[addr - (CART_PRG_RAM_BASE - SRAM_MAP_BASE)] = data;
+    else if(__cart.info.mapper == CART_N163_MAPPER)
+        n163_irq_write(SRAM_MAP_BASE + addr, data);
+}
+
+/**
+ * @brief  映射 8KB PRG bank
+ * @param  slot $8000 起的 8KB 槽位 0-3
+ * @param  offset bank 在 PRG 中的偏移，超出大小时取模
+ * @retval 无
+ * @note 同时登记直接读取，DMA 与 DMC 读取不经过设备查找。
+ */
+static void cart_map_prg(u8 slot, u32 offset)
+{
+    struct cart *c = &__cart;
+    c->prg[slot] = c->info.prg + offset % c->info.prg_size;
+    bus_map_direct(CART_MAP_BASE + slot * CART_PRG_BANK_SIZE, CART_PRG_BANK_SIZE, c->prg[slot]);
+}
+
+/**
+ * @brief  映射 1KB CHR bank
+ * @param  slot PPU 地址空间中的 1KB 槽位 0-7
+ * @param  bank bank 号，超出大小时取模
+ * @retval 无
+ * @note 没有 CHR-ROM 的卡带在 PPU 内部 CHR-RAM 中切换。
+ */
+static void cart_map_chr(u8 slot, u32 bank)
+{
+    const struct cart_info *info = &__cart.info;
+    u32 offset = bank * CHR_BANK_SIZE;
+    if(info->chr)
+    {
+        /* CHR-ROM 只读，去掉 const 仅为匹配接口 */
+        ppu_map_chr(slot, (u8 *)info->chr + offset % info->chr_size, 0);
+    }
+    else
+    {
+        ppu_map_chr(slot, ppu_chr_ram() + offset % PPU_CHR_RAM_SIZE, 1);
+    }
+}
+#pragma endregion
+
+#pragma region "Namco 163"
+/**
+ * @brief  当前的 IRQ 计数值
+ * @retval 15 位计数值
+ * @note 计数器在开启时每个 CPU 周期加 1，到 $7FFF 停止，按经过的周期数计算。
+ */
+static u16 n163_irq_counter(void)
+{
+    struct cart *c = &__cart;
+    if(!c->irq_enable)
+        return c->irq_counter;
+    u64 elapsed = sched_now() / g_sched.timing->cpu_div - c->irq_base;
+    return MIN(CART_N163_IRQ_MAX, c->irq_counter + elapsed);
+}
+
+static void n163_irq_fire(u64 when)
+{
+    UNUSED(when);
+    cpu_irq(CPU_IRQ_MAPPER, 1);
+}
+
+/**
+ * @brief  读取 IRQ 计数器
+ * @param  addr $5000-$57FF 低 8 位，$5800-$5FFF 高 7 位与开启位
+ * @retval 计数器的值
+ */
+static u8 n163_irq_read(u16 addr)
+{
+    u16 counter = n163_irq_counter();
+    if(addr < 0x5800)
+        return counter & 0xFF;
+    return counter >> 8 | __cart.irq_enable << 7;
+}
+
+/**
+ * @brief  写入 IRQ 计数器
+ * @param  addr $5000-$57FF 低 8 位，$5800-$5FFF 高 7 位与开启位
+ * @param  data 数据
+ * @retval 无
+ * @note 写入同时应答 IRQ，并按新的计数值重新调度计数到 $7FFF 的时刻。
+ */
+static void n163_irq_write(u16 addr, u8 data)
+{
+    struct cart *c = &__cart;
+    u16 counter = n163_irq_counter();
+    if(addr < 0x5800)
+    {
+        counter = (counter & 0x7F00) | data;
+    }
+    else
+    {
+        counter = (counter & 0x00FF) | (data & 0x7F) << 8;
+        c->irq_enable = data >> 7;
+    }
+    c->irq_counter = counter;
+    c->irq_base = sched_now() / g_sched.timing->cpu_div;
+    cpu_irq(CPU_IRQ_MAPPER, 0);
+    if(c->irq_enable && counter < CART_N163_IRQ_MAX)
+        sched_event_reschedule(irq_event, (c->irq_base + CART_N163_IRQ_MAX - counter) * g_sched.timing->cpu_div);
+    else
+        sched_event_cancel(irq_event);
+}
+
+/**
+ * @brief  按 $C000-$D800 设置名称表
+ * @param  slot 名称表 0-3
+ * @param  data 写入的值，$E0 起选择 CIRAM 的第 bit0 页
+ * @retval 无
+ * @note 四个名称表都选择 CIRAM 时换算为镜像方式，映射到 CHR-ROM 的名称表未实现。
+ */
+static void n163_map_nametable(u8 slot, u8 data)
+{
+    struct cart *c = &__cart;
+    u8 page = 0;
+    c->nametable[slot] = data;
+    for (u8 i = 0; i < 4; i++)
+    {
+        if(c->nametable[i] < 0xE0)
+            return;
+        page |= (c->nametable[i] & 0x01) << i;
+    }
+    switch (page)
+    {
+    case 0x0: ppu_set_mirroring(PPU_MIRROR_SINGLE0); break;
+    case 0xF: ppu_set_mirroring(PPU_MIRROR_SINGLE1); break;
+    case 0xA: ppu_set_mirroring(PPU_MIRROR_VERTICAL); break;
+    case 0xC: ppu_set_mirroring(PPU_MIRROR_HORIZONTAL); break;
+    }
+}
+
+/**
+ * @brief  写入 $8000-$FFFF 的 mapper 寄存器
+ * @param  addr CPU 地址
+ * @param  data 数据
+ * @retval 无
+ * @note $8000-$B800 为 8 个 1KB CHR bank，$C000-$D800 为名称表，$E000-$F000 为 3 个 8KB PRG bank，
+ *       $E000-$FFFF 固定为最后一个 bank。$E000 bit6 与 $F800 交给音源处理，
+ *       CHR bank $E0 起选择 CIRAM 与 $F800 的 PRG-RAM 写保护未实现。
+ */
+static void n163_map_write(u16 addr, u8 data)
+{
+    u8 reg = (addr >> 11) & 0x07;
+    if(addr < 0xC000)
+        cart_map_chr(reg, data);
+    else if(addr < 0xE000)
+        n163_map_nametable(reg & 0x03, data);
+    else if(addr < 0xF800)
+        cart_map_prg(reg & 0x03, (data & 0x3F) * CART_PRG_BANK_SIZE);
+    if(addr >= 0xE000)
+        n163_write(&__cart.n163, addr, data);
+}
+
+static u8 n163_sound_read(u16 addr)
+{
+    return n163_read(&__cart.n163, CART_N163_SOUND_BASE + addr);
+}
+
+static void n163_sound_write(u16 addr, u8 data)
+{
+    n163_write(&__cart.n163, CART_N163_SOUND_BASE + addr, data);
+}
+
+/**
+ * @brief  挂接音源、声音端口与 IRQ 事件
+ * @retval \c RET_OK: 成功, \c RET_ERR: 失败
+ * @note 需在 \c apu_init 之后调用。
+ */
+static int n163_attach(void)
+{
+    struct cart *c = &__cart;
+    memset(c->nametable, 0, sizeof(c->nametable));
+    c->irq_enable = 0;
+    c->irq_counter = 0;
+    if(n163_init(&c->n163) != RET_OK)
+        return RET_ERR;
+    sound_id = bus_register(sound_name, CART_N163_SOUND_BASE, CART_N163_SOUND_SIZE, n163_sound_read, n163_sound_write);
+    irq_event = sched_event_register(irq_name, n163_irq_fire);
+    return (sound_id == RET_ERR || irq_event == RET_ERR) ? RET_ERR : RET_OK;
+}
+#pragma endregion
+
+#pragma region "卡带"
+/**
+ * @brief  检查 mapper 与 ROM 大小是否支持
+ * @param  info 文件头解析结果
+ * @retval 1: 支持, 0: 不支持
+ */
+static int cart_supported(const struct cart_info *info)
+{
+    if(info->prg_size % CART_PRG_BANK_SIZE || info->chr_size % CHR_BANK_SIZE)
+        return 0;
+    switch (info->mapper)
+    {
+    case 0:
+        return info->prg_size <= CART_MAP_SIZE && info->chr_size <= CHR_BANK_SIZE * PPU_CHR_BANK_NUM;
+    case CART_N163_MAPPER:
+        return info->prg_size <= CART_N163_PRG_MAX && info->chr_size <= CART_N163_CHR_MAX;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief  加载卡带镜像
+ * @param  data 镜像数据，卡带卸载前必须保持有效
+ * @param  size 镜像大小
+ * @retval \c RET_OK: 成功, \c RET_ERR: 镜像非法或 mapper 不支持
+ * @note PRG 与 CHR 直接映射镜像数据，不复制、不分配内存。需在 \c ppu_init 与 \c apu_init 之后调用，
+ *       之前加载的卡带被卸载。目前支持 mapper 0（NROM）与 19（Namco 163）。
+ */
+int cart_load(const u8 *data, size_t size)
+{
+    struct cart *c = &__cart;
+    struct cart_info info;
+
+    if(cart_parse(&info, data, size) != RET_OK)
+    {
+        LOG_L(LOG_ERROR, "invalid iNES image");
+        return RET_ERR;
+    }
+    if(!cart_supported(&info))
+    {
+        LOG_L(LOG_ERROR, "unsupported mapper %u (PRG %u, CHR %u)", info.mapper, info.prg_size, info.chr_size);
+        return RET_ERR;
+    }
+
+    cart_unload();
+    c->info = info;
+    cart_id = bus_register(cart_name, CART_MAP_BASE, CART_MAP_SIZE, cart_read, cart_write);
+    sram_id = bus_register(sram_name, SRAM_MAP_BASE, SRAM_MAP_SIZE, sram_read, sram_write);
+    if(cart_id == RET_ERR || sram_id == RET_ERR)
+    {
+        cart_unload();
+        return RET_ERR;
+    }
+    c->loaded = 1;
+    if(info.mapper == CART_N163_MAPPER && n163_attach() != RET_OK)
+    {
+        cart_unload();
+        return RET_ERR;
+    }
+
+    /* 最后一个槽位固定为最后一个 bank，NROM 的 16KB 镜像也满足这一点 */
+    for (u8 slot = 0; slot < CART_PRG_BANK_NUM - 1; slot++)
+        cart_map_prg(slot, slot * CART_PRG_BANK_SIZE);
+    cart_map_prg(CART_PRG_BANK_NUM - 1, info.prg_size - CART_PRG_BANK_SIZE);
+    memset(c->prg_ram, 0, sizeof(c->prg_ram));
+    if(info.trainer)
+        memcpy(c->prg_ram + 0x1000, info.trainer, CART_TRAINER_SIZE);
+    bus_map_direct(CART_PRG_RAM_BASE, CART_PRG_RAM_SIZE, c->prg_ram);
+
+    if(info.chr)
+        chr_cache_attach(info.chr, info.chr_size);
+    for (u8 slot = 0; slot < PPU_CHR_BANK_NUM; slot++)
+        cart_map_chr(slot, slot);
+    ppu_set_mirroring(info.mirror);
+    return RET_OK;
+}
+
+/**
+ * @brief  以只读方式映射文件并加载
+ * @param  path 镜像路径
+ * @retval \c RET_OK: 成功, \c RET_ERR: 失败
+ * @note 文件在卸载卡带时解除映射，页面由系统按需读入并在实例间共享。
+ */
+int cart_load_file(const char *path)
+{
+#ifdef _WIN32
+    LOG_L(LOG_ERROR, "loading from path is not supported: %s", path);
+    return RET_ERR;
+#else
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        LOG_L(LOG_ERROR, "failed to open %s", path);
+        return RET_ERR;
+    }
+    if(fstat(fd, &st) != 0 || st.st_size < CART_HEADER_SIZE)
+    {
+        close(fd);
+        return RET_ERR;
+    }
+    size_t size = st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        LOG_L(LOG_ERROR, "failed to map %s", path);
+        return RET_ERR;
+    }
+    if(cart_load(map, size) != RET_OK)
+    {
+        munmap(map, size);
+        return RET_ERR;
+    }
+    __cart.image = map;
+    __cart.image_size = size;
+    return RET_OK;
+#endif
+}
+
+/**
+ * @brief  卸载卡带
+ * @retval 无
+ * @note 恢复 PPU 内部 CHR-RAM，未加载时无任何效果。
+ */
+void cart_unload(void)
+{
+    struct cart *c = &__cart;
+    bus_remove(cart_id);
+    bus_remove(sram_id);
+    bus_remove(sound_id);
+    cart_id = sram_id = sound_id = RET_ERR;
+    sched_event_remove(irq_event);
+    irq_event = RET_ERR;
+    if(!c->loaded)
+        return;
+
+    if(c->info.mapper == CART_N163_MAPPER)
+    {
+        n163_remove(&c->n163);
+        cpu_irq(CPU_IRQ_MAPPER, 0);
+    }
+
+    bus_map_direct(CART_MAP_BASE, CART_MAP_SIZE, NULL);
+    bus_map_direct(CART_PRG_RAM_BASE, CART_PRG_RAM_SIZE, NULL);
+    chr_cache_detach(c->info.chr);
+    for (u8 slot = 0; slot < PPU_CHR_BANK_NUM; slot++)
+        ppu_map_chr(slot, NULL, 1);
+#ifndef _WIN32
+    if(c->image)
+        munmap((void *)c->image, c->image_size);
+#endif
+    memset(c, 0, sizeof(*c));
+}
+
+/**
+ * @brief  卡带复位
+ * @retval 无
+ * @note bank 寄存器保持不变，关闭 mapper IRQ 并复位扩展音源。需在 \c sched_reset 与 \c apu_reset 之后调用。
+ */
+void cart_reset(void)
+{
+    struct cart *c = &__cart;
+    if(!c->loaded || c->info.mapper != CART_N163_MAPPER)
+        return;
+    c->irq_enable = 0;
+    c->irq_counter = 0;
+    sched_event_cancel(irq_event);
+    cpu_irq(CPU_IRQ_MAPPER, 0);
+    n163_reset(&c->n163);
+}
+
+/**
+ * @brief  获取已加载卡带的信息
+ * @retval 未加载时返回 NULL
+ */
+const struct cart_info *cart_info(void)
+{
+    return __cart.loaded ? &__cart.info : NULL;
+}
+#pragma endregion
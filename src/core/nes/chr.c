@@ -0,0 +1,148 @@
+#include <string.h>
+#include "log.h"
+#include "core/nes/chr.h"
+
+/* 缓存池最多容纳 512 个 1KB bank，即 512KB 的 CHR 数据 */
+#define CHR_CACHE_BANK_NUM 512
+#define CHR_REGION_MAX_NUM 4
+
+static struct chr_bank pool[CHR_CACHE_BANK_NUM];
+static u32 pool_used;
+
+static struct chr_region
+{
+    const u8 *raw;
+    u32 banks;
+    struct chr_bank *decoded;
+} region[CHR_REGION_MAX_NUM];
+
+/* 将一个字节的 8 个位展开为 8 个字节，最高位在前 */
+static u64 spread[256];
+
+static void chr_init_spread(void)
+{
+    if(spread[0xFF])
+        return;
+    for (unsigned b = 0; b < 256; b++)
+    {
+        u8 bytes[8];
+        for (unsigned i = 0; i < 8; i++)
+            bytes[i] = (b >> (7 - i)) & 1;
+        memcpy(spread + b, bytes, sizeof(bytes));
+    }
+}
+
+/**
+ * @brief  解码一个 1KB bank 的全部图块
+ * @param  out 解码结果
+ * @param  raw 2bpp 原始数据
+ * @retval 无
+ */
+void chr_decode_bank(struct chr_bank *out, const u8 *raw)
+{
+    chr_init_spread();
+    for (unsigned t = 0; t < CHR_BANK_TILES; t++, raw += 16)
+    {
+        for (unsigned row = 0; row < 8; row++)
+        {
+            u64 pixels = spread[raw[row]] | (spread[raw[row + 8]] << 1);
+            memcpy(out->tile[t][row], &pixels, sizeof(pixels));
+        }
+    }
+}
+
+/**
+ * @brief  原始数据被写入后重新解码对应的图块行
+ * @param  out 解码结果
+ * @param  raw bank 原始数据
+ * @param  offset 被写入的字节在 bank 中的偏移
+ * @retval 无
+ * @note CHR-RAM 写入时调用，只更新受影响的一行。
+ */
+void chr_decode_row(struct chr_bank *out, const u8 *raw, u16 offset)
+{
+    unsigned t = (offset >> 4) & (CHR_BANK_TILES - 1);
+    unsigned row = offset & 7;
+    const u8 *tile = raw + t * 16;
+    u64 pixels;
+
+    chr_init_spread();
+    pixels = spread[tile[row]] | (spread[tile[row + 8]] << 1);
+    memcpy(out->tile[t][row], &pixels, sizeof(pixels));
+}
+
+/**
+ * @brief  将一段 CHR 数据加入缓存并立即解码
+ * @param  raw CHR-ROM 或 CHR-RAM 起始地址
+ * @param  size 数据大小，按 1KB bank 对齐
+ * @retval \c RET_OK: 成功, \c RET_ERR: 缓存池不足
+ * @note 缓存池不足时该段数据不缓存，映射时由 PPU 单独解码。
+ */
+int chr_cache_attach(const u8 *raw, size_t size)
+{
+    u32 banks = size / CHR_BANK_SIZE;
+    for (size_t i = 0; i < CHR_REGION_MAX_NUM; i++)
+    {
+        if(region[i].raw != NULL)
+            continue;
+        if(pool_used + banks > CHR_CACHE_BANK_NUM)
+            return RET_ERR;
+        region[i].raw = raw;
+        region[i].banks = banks;
+        region[i].decoded = pool + pool_used;
+        pool_used += banks;
+        for (u32 b = 0; b < banks; b++)
+            chr_decode_bank(region[i].decoded + b, raw + b * CHR_BANK_SIZE);
+        return RET_OK;
+    }
+    return RET_ERR;
+}
+
+/**
+ * @brief  将一段 CHR 数据移出缓存
+ * @param  raw \c chr_cache_attach 时的起始地址
+ * @retval 无
+ * @note 卸载卡带时调用。缓存池按顺序分配，只有最后加入的一段能归还空间。
+ */
+void chr_cache_detach(const u8 *raw)
+{
+    for (size_t i = 0; i < CHR_REGION_MAX_NUM; i++)
+    {
+        if(region[i].raw != raw || raw == NULL)
+            continue;
+        if(region[i].decoded + region[i].banks == pool + pool_used)
+            pool_used -= region[i].banks;
+        memset(region + i, 0, sizeof(region[i]));
+        return;
+    }
+}
+
+/**
+ * @brief  清空缓存
+ * @retval 无
+ * @note 卸载卡带或 PPU 初始化时调用。
+ */
+void chr_cache_reset(void)
+{
+    memset(region, 0, sizeof(region));
+    pool_used = 0;
+}
+
+/**
+ * @brief  查找 bank 对应的解码结果
+ * @param  raw bank 原始数据地址
+ * @retval 解码结果，未缓存时返回 NULL
+ * @note bank 切换时调用，命中时只需交换指针。
+ */
+struct chr_bank *chr_cache_lookup(const u8 *raw)
+{
+    for (size_t i = 0; i < CHR_REGION_MAX_NUM; i++)
+    {
+        if(region[i].raw == NULL || raw < region[i].raw)
+            continue;
+        size_t offset = raw - region[i].raw;
+        if(offset < (size_t)region[i].banks * CHR_BANK_SIZE && offset % CHR_BANK_SIZE == 0)
+            return region[i].decoded + offset / CHR_BANK_SIZE;
+    }
+    return NULL;
+}
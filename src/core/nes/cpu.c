@@ -1,6 +1,7 @@
 #include <string.h>
 #include "core/nes/cpu.h"
 #include "core/nes/bus.h"
+#include "core/nes/sched.h"
 #include "log.h"
 
 /* 指令 地址 操作数*/
@@ -28,6 +29,9 @@ struct cpu_reg
 };
 
 static struct cpu_reg __cpu;
+static u8 __nmi_pending;
+static u8 __irq_line;
+static u16 __stall;
 
 #define __a __cpu.a
 #define __p __cpu.p
@@ -67,6 +71,11 @@ u16 get_int_prt_addr()
     return bus_read(0xFFFE) | (bus_read(0xFFFF) << 8);
 }
 
+u16 get_nmi_prt_addr()
+{
+    return bus_read(0xFFFA) | (bus_read(0xFFFB) << 8);
+}
+
 static u8 cpu_read(u16 addr)
 {
     u8 data = 0;
@@ -471,6 +480,8 @@ void RTI(u16 addr)
     SET_FLAG(FLAG_U, 0);
     __pc = stack_pop();
     __pc |= (stack_pop() << 8);
+    if (__irq_line && !GET_FLAG(FLAG_I))
+        sched_break();
 }
 #   pragma endregion
 
@@ -501,6 +512,8 @@ void PLP(u16 addr)
     UNUSED(addr);
     __p = stack_pop();
     SET_FLAG(FLAG_U, 1);
+    if (__irq_line && !GET_FLAG(FLAG_I))
+        sched_break();
 }
 void TXS(u16 addr)
 {
@@ -519,8 +532,8 @@ void TSX(u16 addr)
 #pragma region "Flags"
 void CLC(u16 addr) { UNUSED(addr); SET_FLAG(FLAG_C, 0); }
 void SEC(u16 addr) { UNUSED(addr); SET_FLAG(FLAG_C, 1); }
-void CLI(u16 addr) { UNUSED(addr); SET_FLAG(FLAG_I, 0); }
-void SEI(u16 addr) { UNUSED(addr); SET_FLAG(FLAG_I, 0); }
+void CLI(u16 addr) { UNUSED(addr); SET_FLAG(FLAG_I, 0); if (__irq_line) sched_break(); }
+void SEI(u16 addr) { UNUSED(addr); SET_FLAG(FLAG_I, 1); }
 void CLD(u16 addr) { UNUSED(addr); SET_FLAG(FLAG_D, 0); }
 void SED(u16 addr) { UNUSED(addr); SET_FLAG(FLAG_D, 0); }
 void CLV(u16 addr) { UNUSED(addr); SET_FLAG(FLAG_V, 0); }
@@ -637,9 +650,27 @@ dev_id cpu_init()
         bus_remove(cpu_id);
     cpu_id = bus_register(cpu_name, CPU_MAP_BASE, CPU_MAP_SIZE, &cpu_read, &cpu_write);
     memset(&__cpu, 0, sizeof(__cpu));
+    __nmi_pending = 0;
+    __irq_line = 0;
+    __stall = 0;
     return cpu_id;
 }
 
+/**
+ * @brief  CPU复位
+ * @retval 无
+ * @note 从 $FFFC 读取复位向量，设置 I 标志，占用 7 个周期。需在卡带加载及 \c sched_reset 之后调用。
+ */
+void cpu_reset()
+{
+    __sp = 0xFD;
+    __p = FLAG_I | FLAG_U;
+    __pc = bus_read(0xFFFC) | (bus_read(0xFFFD) << 8);
+    __nmi_pending = 0;
+    __stall = 0;
+    g_sched.clock += 7 * g_sched.timing->cpu_div;
+}
+
 /**
  * @brief  CPU执行一个周期
  * @retval 无
@@ -656,4 +687,99 @@ void cpu_clock()
         cycle = op->cycles;
     }
 }
+
+/**
+ * @brief  进入中断处理
+ * @param  vector 中断向量地址
+ * @retval 无
+ * @note 中断响应占用 7 个周期。
+ */
+static void cpu_interrupt(u16 vector)
+{
+    stack_push((__pc & 0xFF00) >> 8);
+    stack_push(__pc & 0xFF);
+    SET_FLAG(FLAG_B, 0);
+    stack_push(__p | FLAG_U);
+    SET_FLAG(FLAG_I, 1);
+    __pc = vector;
+    g_sched.clock += 7 * g_sched.timing->cpu_div;
+}
+
+/**
+ * @brief  触发 NMI
+ * @retval 无
+ * @note NMI 为边沿触发，在下一条指令前响应。
+ */
+void cpu_nmi()
+{
+    __nmi_pending = 1;
+    sched_break();
+}
+
+/**
+ * @brief  设置 IRQ 线电平
+ * @param  source 中断源掩码，每个设备占用一位
+ * @param  level 非 0 表示拉低 IRQ 线
+ * @retval 无
+ * @note IRQ 为电平触发，任意中断源有效且 I 标志清零时响应。
+ */
+void cpu_irq(u8 source, u8 level)
+{
+    if(level)
+        __irq_line |= source;
+    else
+        __irq_line &= ~source;
+    if(__irq_line && !GET_FLAG(FLAG_I))
+        sched_break();
+}
+
+/**
+ * @brief  DMA 占用 CPU 周期
+ * @param  cycles 被占用的 CPU 周期数
+ * @retval 无
+ * @note 在事件回调中调用，周期在下一批次开始时一次扣除，指令循环中没有额外检查。
+ */
+void cpu_stall(u16 cycles)
+{
+    __stall += cycles;
+}
+
+/**
+ * @brief  响应挂起的中断
+ * @retval 无
+ * @note 仅在批次开始时调用，需要响应中断的事件通过 \c sched_break 结束批次。
+ */
+static void cpu_poll_interrupt()
+{
+    if(__nmi_pending)
+    {
+        __nmi_pending = 0;
+        cpu_interrupt(get_nmi_prt_addr());
+    }
+    else if(__irq_line && !GET_FLAG(FLAG_I))
+    {
+        cpu_interrupt(get_int_prt_addr());
+    }
+}
+
+/**
+ * CPU 批量执行指令直到调度器的批次结束时刻。
+ * 每个制式实例化一份，指令周期到主时钟周期的换算为编译期常量。
+ */
+#define CPU_RUN_DEFINE(ID, name, hz, cpu_div, ...) \
+void cpu_run_##name() \
+{ \
+    g_sched.clock += (u64)__stall * cpu_div; \
+    __stall = 0; \
+    cpu_poll_interrupt(); \
+    while (g_sched.clock < g_sched.deadline) \
+    { \
+        struct operation *op = get_operation(); \
+        u16 addr = op->addressing_func(); \
+        op->instruction_func(addr); \
+        g_sched.clock += (op->cycles + 1) * cpu_div; \
+    } \
+}
+REGION_LIST(CPU_RUN_DEFINE)
+#undef CPU_RUN_DEFINE
 #pragma endregion
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include <string.h>
+#include "log.h"
+#include "core/nes/n163.h"
+
+#define N163_PERIOD 15          /* 每个声道更新占用的 CPU 周期 */
+#define N163_GAIN 48            /* 单个声道满幅 120 对应约 5800 的采样值 */
+
+static char n163_name[] = "Namco 163";
+
+#pragma region "合成"
+/**
+ * @brief  启用的声道数
+ * @param  n 芯片
+ * @retval 1-8
+ * @note 由 $7F 的 bit4-6 决定，启用的总是编号最大的几个声道。
+ */
+static inline unsigned n163_channels(const struct n163 *n)
+{
+    return ((n->ram[0x7F] >> 4) & 0x07) + 1;
+}
+
+/**
+ * @brief  更新一个声道并输出
+ * @param  n 芯片
+ * @param  when 更新时刻（CPU 周期）
+ * @retval 无
+ * @note 相位写回 RAM，CPU 可以读到。分时复用的 DAC 按声道平均输出，
+ *       声道数少时每个声道更响，与硬件一致。
+ */
+static void n163_step(struct n163 *n, u64 when)
+{
+    unsigned count = n163_channels(n);
+    unsigned ch = n->channel;
+    /* 声道 0 之后 channel 回绕为 255，也从最后一个声道重新开始 */
+    if(ch >= N163_CH_NUM || ch < N163_CH_NUM - count)
+        ch = N163_CH_NUM - 1;
+    u8 *reg = n->ram + N163_REG_BASE + ch * 8;
+
+    u32 freq = reg[0] | reg[2] << 8 | (reg[4] & 0x03) << 16;
+    u32 phase = reg[1] | reg[3] << 8 | reg[5] << 16;
+    u32 length = (256 - (reg[4] & 0xFC)) << 16;
+    phase = (phase + freq) % length;
+    reg[1] = phase;
+    reg[3] = phase >> 8;
+    reg[5] = phase >> 16;
+
+    u8 pos = (phase >> 16) + reg[6];
+    u8 sample = (n->ram[pos >> 1] >> ((pos & 1) * 4)) & 0x0F;
+    n->level[ch] = (sample - 8) * (reg[7] & 0x0F);
+    n->channel = ch - 1;
+
+    int sum = 0;
+    for (unsigned i = N163_CH_NUM - count; i < N163_CH_NUM; i++)
+        sum += n->level[i];
+    apu_expansion_output(n->id, sum * N163_GAIN / (int)count, when);
+}
+
+/**
+ * @brief  追赶回调
+ * @param  chip 芯片
+ * @param  from 起始 CPU 周期
+ * @param  to 结束 CPU 周期
+ * @retval 无
+ * @note 每 15 个周期一次更新，关闭声音时计时照常但不更新声道。
+ */
+static void n163_run(void *chip, u64 from, u64 to)
+{
+    struct n163 *n = chip;
+    if(n->next < from)
+        n->next = from;
+    for (; n->next < to; n->next += N163_PERIOD)
+    {
+        if(!n->disable)
+            n163_step(n, n->next);
+    }
+}
+#pragma endregion
+
+#pragma region "寄存器"
+/**
+ * @brief  读取芯片寄存器
+ * @param  n 芯片
+ * @param  addr CPU 地址
+ * @retval $4800-$4FFF 返回 RAM 数据，其他地址返回 0
+ * @note 自动递增模式下读取后地址加 1。
+ */
+u8 n163_read(struct n163 *n, u16 addr)
+{
+    if((addr & 0xF800) != 0x4800)
+        return 0;
+    apu_expansion_sync();
+    u8 data = n->ram[n->addr & 0x7F];
+    if(n->addr & 0x80)
+        n->addr = 0x80 | ((n->addr + 1) & 0x7F);
+    return data;
+}
+
+/**
+ * @brief  写入芯片寄存器
+ * @param  n 芯片
+ * @param  addr CPU 地址：$4800 数据，$E000 bit6 关闭声音，$F800 地址
+ * @param  data 数据
+ * @retval 无
+ * @note 其他地址被忽略，$E000 与 $F800 的其余位由 mapper 自己处理。
+ */
+void n163_write(struct n163 *n, u16 addr, u8 data)
+{
+    switch (addr & 0xF800)
+    {
+    case 0x4800:
+        apu_expansion_sync();
+        n->ram[n->addr & 0x7F] = data;
+        if(n->addr & 0x80)
+            n->addr = 0x80 | ((n->addr + 1) & 0x7F);
+        break;
+    case 0xE000:
+        apu_expansion_sync();
+        n->disable = (data >> 6) & 0x01;
+        break;
+    case 0xF800:
+        n->addr = data;
+        break;
+    }
+}
+#pragma endregion
+
+#pragma region "N163"
+/**
+ * @brief  芯片复位
+ * @param  n 芯片
+ * @retval 无
+ * @note 内部 RAM 保持不变，带电池的卡带由 mapper 负责存档。需在 \c apu_reset 之后调用。
+ */
+void n163_reset(struct n163 *n)
+{
+    apu_expansion_sync();
+    n->addr = 0;
+    n->disable = 0;
+    n->channel = N163_CH_NUM - 1;
+    n->next = 0;
+    memset(n->level, 0, sizeof(n->level));
+}
+
+/**
+ * @brief  初始化并挂接到 APU
+ * @param  n 芯片
+ * @retval RET_OK 或 RET_ERR
+ * @note 需在 \c apu_init 之后调用。
+ */
+int n163_init(struct n163 *n)
+{
+    memset(n, 0, sizeof(*n));
+    n->channel = N163_CH_NUM - 1;
+    n->id = apu_expansion_register(n163_name, n163_run, n);
+    return n->id == RET_ERR ? RET_ERR : RET_OK;
+}
+
+/**
+ * @brief  从 APU 卸下
+ * @param  n 芯片
+ * @retval 无
+ */
+void n163_remove(struct n163 *n)
+{
+    apu_expansion_remove(n->id);
+    n->id = RET_ERR;
+}
+#pragma endregion
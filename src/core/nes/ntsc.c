@@ -0,0 +1,435 @@
+#include <math.h>
+#include <string.h>
+#include <pthread.h>
+#include "log.h"
+#include "core/nes/ntsc.h"
+#include "core/nes/palette.h"
+#include "core/nes/pixel.h"
+#include "core/nes/simd.h"
+
+/*
+ * 复合信号模拟：每个 PPU 像素为 8 个采样（主时钟），色副载波周期为 12 个采样，
+ * 像素起始相位只有 3 种。解码是线性的，因此预先算出每种颜色、每种相位的像素
+ * 对周围输出像素的贡献（核），滤波时只需把核累加到行缓冲。
+ */
+#define NTSC_SAMPLES 8          /* 每个 PPU 像素的采样数 */
+#define NTSC_PERIOD 12          /* 色副载波周期 */
+#define NTSC_PHASES 3
+#define NTSC_LUMA_WINDOW 12     /* 亮度解码窗口 */
+#define NTSC_CHROMA_WINDOW 24   /* 色度解码窗口，越宽颜色越模糊 */
+#define NTSC_HUE 3.9            /* 解码相位校正，单位为采样 */
+#define NTSC_TAPS 8             /* 核覆盖的输出像素数 */
+#define NTSC_TAP_OFFSET 3       /* 第 0 个核系数对应的输出像素相对 2 * x 的偏移 */
+#define NTSC_CHANNELS 4         /* 行缓冲按 B、G、R、X 排列，累加结果可直接收窄为 XRGB8888 */
+#define NTSC_SHIFT 5            /* 核系数的小数位数 */
+#define NTSC_ATTENUATION 0.746  /* 强调位衰减 */
+#define NTSC_LINE ((NTSC_WIDTH + NTSC_TAPS) * NTSC_CHANNELS)
+#define NTSC_CHUNKS (NTSC_LINE / 8)
+
+typedef void (*ntsc_line_fn)(void *out, u8 bytes, const u16 *index, unsigned phase);
+
+/* 核：[起始相位][颜色下标][输出像素][通道] */
+static s16 ntsc_kernel[NTSC_PHASES][PALETTE_SIZE][NTSC_TAPS * NTSC_CHANNELS] __attribute__((aligned(32)));
+
+#pragma region "信号"
+/**
+ * @brief  某个颜色在某个相位的复合信号电平
+ * @param  index 9 位颜色下标
+ * @param  phase 采样相位 0-11
+ * @retval 归一化电平，黑为 0，白为 1
+ */
+static double ntsc_signal(u16 index, unsigned phase)
+{
+    static const double low[4] = { 0.350, 0.518, 0.962, 1.550 };
+    static const double high[4] = { 1.094, 1.506, 1.962, 1.962 };
+    const double black = 0.518, white = 1.962;
+    unsigned hue = index & 0x0F, level = (index >> 4) & 3;
+    u8 emphasis = index >> 6;
+
+    if(hue > 13)
+        level = 1;
+    double lo = low[level], hi = high[level];
+    if(hue == 0)
+        lo = hi;
+    if(hue > 12)
+        hi = lo;
+    double v = (hue + phase) % NTSC_PERIOD < 6 ? hi : lo;
+
+    /* R、G、B 强调分别在 0xC、0x4、0x8 号色相的相位上衰减 */
+    if(((emphasis & 1) && (0xC + phase) % NTSC_PERIOD < 6) || ((emphasis & 2) && (0x4 + phase) % NTSC_PERIOD < 6)
+       || ((emphasis & 4) && (0x8 + phase) % NTSC_PERIOD < 6))
+        v *= NTSC_ATTENUATION;
+    return (v - black) / (white - black);
+}
+
+static inline s16 ntsc_fixed(double v)
+{
+    return (s16)lrint(v * 255 * (1 << NTSC_SHIFT));
+}
+
+/**
+ * @brief  计算一个像素的核
+ * @param  out 核
+ * @param  index 9 位颜色下标
+ * @param  start 像素第一个采样的相位
+ * @retval 无
+ * @note 在每个输出像素中心按窗口求亮度与两路色度，再由 YIQ 转换为 RGB。
+ */
+static void ntsc_build_kernel(s16 *out, u16 index, unsigned start)
+{
+    double signal[NTSC_SAMPLES];
+    for (unsigned j = 0; j < NTSC_SAMPLES; j++)
+        signal[j] = ntsc_signal(index, (start + j) % NTSC_PERIOD);
+
+    for (int t = 0; t < NTSC_TAPS; t++)
+    {
+        /* 输出像素宽 4 个采样，中心相对像素起点的位置 */
+        int center = (t - NTSC_TAP_OFFSET) * 4 + 2;
+        double y = 0, i = 0, q = 0;
+        for (int j = 0; j < NTSC_SAMPLES; j++)
+        {
+            int d = j - center;
+            double angle = M_PI * (start + j + NTSC_HUE) / 6;
+            if(d >= -NTSC_LUMA_WINDOW / 2 && d < NTSC_LUMA_WINDOW / 2)
+                y += signal[j] / NTSC_LUMA_WINDOW;
+            if(d >= -NTSC_CHROMA_WINDOW / 2 && d < NTSC_CHROMA_WINDOW / 2)
+            {
+                i += signal[j] * 2 * cos(angle) / NTSC_CHROMA_WINDOW;
+                q += signal[j] * 2 * sin(angle) / NTSC_CHROMA_WINDOW;
+            }
+        }
+        s16 *px = out + t * NTSC_CHANNELS;
+        px[0] = ntsc_fixed(y - 1.108545 * i + 1.709007 * q);
+        px[1] = ntsc_fixed(y - 0.274788 * i - 0.635691 * q);
+        px[2] = ntsc_fixed(y + 0.946882 * i + 0.623557 * q);
+        px[3] = 0;
+    }
+}
+#pragma endregion
+
+#pragma region "标量"
+/**
+ * @brief  取一行各像素的核
+ * @param  kp 核指针，下标为像素横坐标加 3，行外的像素为零核
+ * @param  index 一行颜色下标
+ * @param  phase 行首像素的相位 0-2
+ * @retval 无
+ * @note 相邻像素的起始相位依次相差 8 个采样，即相位编号加 2。
+ *       行缓冲中每 8 个系数为一组，第 m 组是像素 m、m-1、m-2、m-3 的核中对应的一组之和，
+ *       向量实现据此逐组求和，避免相互重叠的读改写。
+ */
+static void ntsc_kernels(const s16 **kp, const u16 *index, unsigned phase)
+{
+    static const s16 zero[NTSC_TAPS * NTSC_CHANNELS] __attribute__((aligned(32)));
+    for (unsigned i = 0; i < NTSC_CHUNKS + 3; i++)
+        kp[i] = zero;
+    for (unsigned x = 0; x < PPU_WIDTH; x++, phase = (phase + 2) % NTSC_PHASES)
+        kp[x + 3] = ntsc_kernel[phase][index[x]];
+}
+
+/* 把每个像素的核累加到行缓冲 */
+static void ntsc_accumulate_scalar(s16 *acc, const u16 *index, unsigned phase)
+{
+    const s16 *kp[NTSC_CHUNKS + 3];
+    ntsc_kernels(kp, index, phase);
+    for (unsigned x = 0; x < PPU_WIDTH; x++)
+    {
+        s16 *a = acc + x * 2 * NTSC_CHANNELS;
+        for (unsigned i = 0; i < NTSC_TAPS * NTSC_CHANNELS; i++)
+            a[i] += kp[x + 3][i];
+    }
+}
+
+static inline u8 ntsc_clamp(s16 v)
+{
+    v >>= NTSC_SHIFT;
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+static void ntsc_line_scalar(void *out, u8 bytes, const u16 *index, unsigned phase)
+{
+    s16 acc[NTSC_LINE];
+    for (unsigned i = 0; i < NTSC_LINE; i++)
+        acc[i] = 1 << (NTSC_SHIFT - 1);
+    ntsc_accumulate_scalar(acc, index, phase);
+
+    const s16 *a = acc + NTSC_TAP_OFFSET * NTSC_CHANNELS;
+    for (unsigned x = 0; x < NTSC_WIDTH; x++, a += NTSC_CHANNELS)
+    {
+        u8 b = ntsc_clamp(a[0]), g = ntsc_clamp(a[1]), r = ntsc_clamp(a[2]);
+        if(bytes == sizeof(u16))
+            ((u16 *)out)[x] = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+        else
+            ((u32 *)out)[x] = (r << 16) | (g << 8) | b;
+    }
+}
+#pragma endregion
+
+#if SIMD_X86
+#pragma region "SSE2"
+/* XRGB8888 收窄为 RGB565，先符号扩展低 16 位以便饱和收窄保持原值 */
+SIMD_TARGET("sse2")
+static inline __m128i ntsc_rgb565_sse2(__m128i v)
+{
+    __m128i r = _mm_and_si128(_mm_srli_epi32(v, 8), _mm_set1_epi32(0xF800));
+    __m128i g = _mm_and_si128(_mm_srli_epi32(v, 5), _mm_set1_epi32(0x07E0));
+    __m128i b = _mm_and_si128(_mm_srli_epi32(v, 3), _mm_set1_epi32(0x001F));
+    v = _mm_or_si128(_mm_or_si128(r, g), b);
+    return _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+}
+
+/* 每组 8 个系数由 4 个像素的核相加得到 */
+SIMD_TARGET("sse2")
+static void ntsc_line_sse2(void *out, u8 bytes, const u16 *index, unsigned phase)
+{
+    s16 acc[NTSC_LINE] __attribute__((aligned(16)));
+    const s16 *kp[NTSC_CHUNKS + 3];
+    const __m128i bias = _mm_set1_epi16(1 << (NTSC_SHIFT - 1));
+
+    ntsc_kernels(kp, index, phase);
+    for (unsigned m = 0; m < NTSC_CHUNKS; m++)
+    {
+        __m128i v = bias;
+        for (unsigned j = 0; j < 4; j++)
+            v = _mm_add_epi16(v, _mm_load_si128((const __m128i *)(kp[m + 3 - j] + j * 8)));
+        _mm_store_si128((__m128i *)(acc + m * 8), v);
+    }
+
+    const s16 *a = acc + NTSC_TAP_OFFSET * NTSC_CHANNELS;
+    for (unsigned x = 0; x < NTSC_WIDTH; x += 4, a += 4 * NTSC_CHANNELS)
+    {
+        __m128i lo = _mm_srai_epi16(_mm_loadu_si128((const __m128i *)a), NTSC_SHIFT);
+        __m128i hi = _mm_srai_epi16(_mm_loadu_si128((const __m128i *)(a + 8)), NTSC_SHIFT);
+        __m128i px = _mm_packus_epi16(lo, hi);
+        if(bytes == sizeof(u16))
+            _mm_storel_epi64((__m128i *)((u16 *)out + x), _mm_packs_epi32(ntsc_rgb565_sse2(px), _mm_setzero_si128()));
+        else
+            _mm_storeu_si128((__m128i *)((u32 *)out + x), px);
+    }
+}
+#pragma endregion
+
+#pragma region "AVX2"
+SIMD_TARGET("avx2")
+static inline __m256i ntsc_rgb565_avx2(__m256i v)
+{
+    __m256i r = _mm256_and_si256(_mm256_srli_epi32(v, 8), _mm256_set1_epi32(0xF800));
+    __m256i g = _mm256_and_si256(_mm256_srli_epi32(v, 5), _mm256_set1_epi32(0x07E0));
+    __m256i b = _mm256_and_si256(_mm256_srli_epi32(v, 3), _mm256_set1_epi32(0x001F));
+    v = _mm256_or_si256(_mm256_or_si256(r, g), b);
+    return _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16);
+}
+
+/* 一次求相邻两组系数，输出一次处理 8 个像素 */
+SIMD_TARGET("avx2")
+static void ntsc_line_avx2(void *out, u8 bytes, const u16 *index, unsigned phase)
+{
+    s16 acc[NTSC_LINE] __attribute__((aligned(32)));
+    const s16 *kp[NTSC_CHUNKS + 3];
+    const __m256i bias = _mm256_set1_epi16(1 << (NTSC_SHIFT - 1));
+
+    ntsc_kernels(kp, index, phase);
+    for (unsigned m = 0; m < NTSC_CHUNKS; m += 2)
+    {
+        __m256i v = bias;
+        for (unsigned j = 0; j < 4; j++)
+        {
+            __m128i lo = _mm_load_si128((const __m128i *)(kp[m + 3 - j] + j * 8));
+            __m128i hi = _mm_load_si128((const __m128i *)(kp[m + 4 - j] + j * 8));
+            v = _mm256_add_epi16(v, _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1));
+        }
+        _mm256_store_si256((__m256i *)(acc + m * 8), v);
+    }
+
+    const s16 *a = acc + NTSC_TAP_OFFSET * NTSC_CHANNELS;
+    for (unsigned x = 0; x < NTSC_WIDTH; x += 8, a += 8 * NTSC_CHANNELS)
+    {
+        __m256i lo = _mm256_srai_epi16(_mm256_loadu_si256((const __m256i *)a), NTSC_SHIFT);
+        __m256i hi = _mm256_srai_epi16(_mm256_loadu_si256((const __m256i *)(a + 16)), NTSC_SHIFT);
+        /* 收窄在各 128 位通道内进行，重排后恢复像素顺序 */
+        __m256i px = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+        if(bytes == sizeof(u16))
+        {
+            __m256i v = _mm256_packs_epi32(ntsc_rgb565_avx2(px), _mm256_setzero_si256());
+            _mm_storeu_si128((__m128i *)((u16 *)out + x), _mm256_castsi256_si128(_mm256_permute4x64_epi64(v, 0xD8)));
+        }
+        else
+            _mm256_storeu_si256((__m256i *)((u32 *)out + x), px);
+    }
+}
+#pragma endregion
+#endif
+
+static const ntsc_line_fn ntsc_line_table[PIXEL_KERNEL_NUM] = {
+    [PIXEL_KERNEL_SCALAR] = ntsc_line_scalar,
+#if SIMD_X86
+    [PIXEL_KERNEL_SSE2] = ntsc_line_sse2,
+    [PIXEL_KERNEL_AVX2] = ntsc_line_avx2,
+#endif
+};
+
+#pragma region "线程"
+/* 一帧的滤波任务，按扫描线分段 */
+struct ntsc_job
+{
+    void *out;
+    size_t pitch;
+    u8 bytes;
+    const u16 *index;
+    unsigned top;
+    unsigned height;
+    unsigned frame;
+};
+
+static struct ntsc_pool
+{
+    pthread_t thread[NTSC_THREAD_MAX];
+    unsigned num;       /* 包括调用者在内的线程数 */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    u32 generation;
+    unsigned pending;
+    u8 quit;
+    struct ntsc_job job;
+} pool = {
+    .num = 1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+/**
+ * @brief  滤波一段扫描线
+ * @param  job 任务
+ * @param  band 段号
+ * @param  bands 段数
+ * @retval 无
+ */
+static void ntsc_run_band(const struct ntsc_job *job, unsigned band, unsigned bands)
+{
+    ntsc_line_fn line_fn = ntsc_line_table[pixel_kernel()];
+    unsigned from = job->height * band / bands, to = job->height * (band + 1) / bands;
+    for (unsigned y = from; y < to; y++)
+    {
+        unsigned line = job->top + y;
+        /* 每行的起始相位前移 4 个采样，每帧再整体移动一次 */
+        line_fn((u8 *)job->out + y * job->pitch, job->bytes, job->index + line * PPU_WIDTH,
+                (line + job->frame) % NTSC_PHASES);
+    }
+}
+
+static void *ntsc_worker(void *arg)
+{
+    unsigned band = (unsigned)(uintptr_t)arg;
+    u32 generation = 0;
+
+    pthread_mutex_lock(&pool.lock);
+    while (1)
+    {
+        while (pool.generation == generation && !pool.quit)
+            pthread_cond_wait(&pool.cond, &pool.lock);
+        if(pool.quit)
+            break;
+        generation = pool.generation;
+        struct ntsc_job job = pool.job;
+        unsigned bands = pool.num;
+        pthread_mutex_unlock(&pool.lock);
+
+        ntsc_run_band(&job, band, bands);
+
+        pthread_mutex_lock(&pool.lock);
+        if(--pool.pending == 0)
+            pthread_cond_broadcast(&pool.cond);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+/**
+ * @brief  设置滤波使用的线程数
+ * @param  num 包括调用者在内的线程数，1 表示不使用工作线程
+ * @retval RET_OK: 成功, RET_ERR: 线程数超出范围或无法创建线程
+ */
+int ntsc_set_threads(unsigned num)
+{
+    if(num == 0 || num > NTSC_THREAD_MAX)
+        return RET_ERR;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.quit = 1;
+    pthread_cond_broadcast(&pool.cond);
+    pthread_mutex_unlock(&pool.lock);
+    for (unsigned i = 1; i < pool.num; i++)
+        pthread_join(pool.thread[i], NULL);
+
+    pool.quit = 0;
+    pool.generation = 0;
+    pool.num = 1;
+    for (unsigned i = 1; i < num; i++)
+    {
+        if(pthread_create(&pool.thread[i], NULL, ntsc_worker, (void *)(uintptr_t)i))
+            return RET_ERR;
+        pool.num++;
+    }
+    return RET_OK;
+}
+
+/**
+ * @brief  查询滤波使用的线程数
+ * @retval 包括调用者在内的线程数
+ */
+unsigned ntsc_threads(void)
+{
+    return pool.num;
+}
+#pragma endregion
+
+/**
+ * @brief  生成各颜色各相位的核
+ * @retval 无
+ */
+void ntsc_init(void)
+{
+    for (unsigned phase = 0; phase < NTSC_PHASES; phase++)
+    {
+        for (u16 index = 0; index < PALETTE_SIZE; index++)
+            ntsc_build_kernel(ntsc_kernel[phase][index], index, phase * 4);
+    }
+}
+
+/**
+ * @brief  对一帧颜色下标做 NTSC 复合信号滤波
+ * @param  out 输出画面，宽 \c NTSC_WIDTH
+ * @param  pitch 行跨度（字节）
+ * @param  bytes 每像素字节数：2 为 RGB565，4 为 XRGB8888
+ * @param  index 256x240 颜色下标，见 \c ppu_frame_index
+ * @param  top 第一条输出的扫描线
+ * @param  height 输出的扫描线数
+ * @param  frame 帧计数，用于交替色副载波相位
+ * @retval 无
+ * @note 开启工作线程时按扫描线分段并行，返回时整帧已完成。
+ */
+void ntsc_filter(void *out, size_t pitch, u8 bytes, const u16 *index, unsigned top, unsigned height, unsigned frame)
+{
+    struct ntsc_job job = { out, pitch, bytes, index, top, height, frame };
+
+    LOG_ASSERT(top + height <= PPU_HEIGHT);
+    if(pool.num == 1)
+    {
+        ntsc_run_band(&job, 0, 1);
+        return;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.job = job;
+    pool.pending = pool.num - 1;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.cond);
+    pthread_mutex_unlock(&pool.lock);
+
+    ntsc_run_band(&job, 0, pool.num);
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.pending)
+        pthread_cond_wait(&pool.cond, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+}
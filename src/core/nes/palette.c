@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include "log.h"
+#include "core/nes/palette.h"
+
+/* 强调位生效时，未被强调的颜色通道按此比例衰减 */
+#define PALETTE_EMPHASIS_ATTENUATION 0.816328
+
+/* 2C02 默认调色板 */
+static const u32 palette_default[PALETTE_COLORS] = {
+    0x666666, 0x002A88, 0x1412A7, 0x3B00A4, 0x5C007E, 0x6E0040, 0x6C0600, 0x561D00,
+    0x333500, 0x0B4800, 0x005200, 0x004F08, 0x00404D, 0x000000, 0x000000, 0x000000,
+    0xADADAD, 0x155FD9, 0x4240FF, 0x7527FE, 0xA01ACC, 0xB71E7B, 0xB53120, 0x994E00,
+    0x6B6D00, 0x388700, 0x0C9300, 0x008F32, 0x007C8D, 0x000000, 0x000000, 0x000000,
+    0xFFFEFF, 0x64B0FF, 0x9290FF, 0xC676FF, 0xF36AFF, 0xFE6ECC, 0xFE8170, 0xEA9E22,
+    0xBCBE00, 0x88D800, 0x5CE430, 0x45E082, 0x48CDDE, 0x4F4F4F, 0x000000, 0x000000,
+    0xFFFEFF, 0xC0DFFF, 0xD3D2FF, 0xE8C8FF, 0xFBC2FF, 0xFEC4EA, 0xFECCC5, 0xF7D8A5,
+    0xE4E594, 0xCFEF96, 0xBDF4AB, 0xB3F3CC, 0xB5EBF2, 0xB8B8B8, 0x000000, 0x000000,
+};
+
+/* 各输出格式的查找表，RGB565 只使用低 16 位 */
+static u32 table[PALETTE_FORMAT_NUM][PALETTE_SIZE];
+static enum palette_format format = PALETTE_XRGB8888;
+
+static inline u32 palette_to_rgb565(u32 rgb)
+{
+    return ((rgb >> 8) & 0xF800) | ((rgb >> 5) & 0x07E0) | ((rgb >> 3) & 0x001F);
+}
+
+/**
+ * @brief  对颜色施加强调位
+ * @param  rgb XRGB8888 颜色
+ * @param  emphasis 强调位，bit0-2 依次为 R、G、B
+ * @retval 强调后的颜色
+ */
+static u32 palette_emphasis(u32 rgb, u8 emphasis)
+{
+    double channel[3] = { (rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF };
+    for (unsigned e = 0; e < 3; e++)
+    {
+        if(!(emphasis & (1 << e)))
+            continue;
+        for (unsigned c = 0; c < 3; c++)
+        {
+            if(c != e)
+                channel[c] *= PALETTE_EMPHASIS_ATTENUATION;
+        }
+    }
+    return ((u32)channel[0] << 16) | ((u32)channel[1] << 8) | (u32)channel[2];
+}
+
+/**
+ * @brief  由 512 项 XRGB8888 颜色生成各格式查找表
+ * @param  rgb 按颜色下标排列的颜色
+ * @retval 无
+ */
+static void palette_build(const u32 *rgb)
+{
+    for (unsigned i = 0; i < PALETTE_SIZE; i++)
+    {
+        table[PALETTE_XRGB8888][i] = rgb[i] & 0xFFFFFF;
+        table[PALETTE_RGB565][i] = palette_to_rgb565(rgb[i]);
+    }
+}
+
+/**
+ * @brief  由 64 色基础调色板推算强调位并生成查找表
+ * @param  base 64 项 XRGB8888 颜色
+ * @retval 无
+ */
+static void palette_build_base(const u32 *base)
+{
+    u32 rgb[PALETTE_SIZE];
+    for (unsigned i = 0; i < PALETTE_SIZE; i++)
+        rgb[i] = palette_emphasis(base[i % PALETTE_COLORS], i / PALETTE_COLORS);
+    palette_build(rgb);
+}
+
+/**
+ * @brief  使用默认调色板生成查找表
+ * @retval 无
+ */
+void palette_init(void)
+{
+    palette_build_base(palette_default);
+}
+
+/**
+ * @brief  加载 .pal 调色板文件
+ * @param  path 文件路径
+ * @retval RET_OK: 成功, RET_ERR: 文件不存在或大小不符
+ * @note 支持 64 色（192 字节）与含强调位的 512 色（1536 字节）两种文件，
+ *       失败时保持原有调色板。
+ */
+int palette_load(const char *path)
+{
+    u8 data[PALETTE_SIZE * 3 + 1];
+    u32 rgb[PALETTE_SIZE];
+    FILE *fp = fopen(path, "rb");
+    if(fp == NULL)
+        return RET_ERR;
+    size_t size = fread(data, 1, sizeof(data), fp);
+    fclose(fp);
+    if(size != PALETTE_COLORS * 3 && size != PALETTE_SIZE * 3)
+    {
+        LOG_L(LOG_WARN, "%s: invalid palette size %zu", path, size);
+        return RET_ERR;
+    }
+
+    for (size_t i = 0; i < size / 3; i++)
+        rgb[i] = (data[i * 3] << 16) | (data[i * 3 + 1] << 8) | data[i * 3 + 2];
+    if(size == PALETTE_SIZE * 3)
+        palette_build(rgb);
+    else
+        palette_build_base(rgb);
+    return RET_OK;
+}
+
+/**
+ * @brief  设置输出像素格式
+ * @param  fmt 像素格式
+ * @retval 无
+ */
+void palette_set_format(enum palette_format fmt)
+{
+    LOG_ASSERT(fmt >= 0 && fmt < PALETTE_FORMAT_NUM);
+    format = fmt;
+}
+
+/**
+ * @brief  查询输出像素格式
+ * @retval 像素格式
+ */
+enum palette_format palette_format(void)
+{
+    return format;
+}
+
+/**
+ * @brief  获取当前输出格式的查找表
+ * @retval 512 项查找表，按颜色下标索引
+ */
+const u32 *palette_lut(void)
+{
+    return table[format];
+}
+
+/**
+ * @brief  获取指定输出格式的查找表
+ * @param  fmt 像素格式
+ * @retval 512 项查找表，按颜色下标索引
+ */
+const u32 *palette_table(enum palette_format fmt)
+{
+    LOG_ASSERT(fmt >= 0 && fmt < PALETTE_FORMAT_NUM);
+    return table[fmt];
+}
@@ -0,0 +1,295 @@
+#include "log.h"
+#include "core/nes/pixel.h"
+#include "core/nes/simd.h"
+
+typedef void (*pixel_compose_fn)(u16 *out, const u8 *bg, const u8 *spr, const u16 *lut, unsigned n);
+typedef void (*pixel_convert32_fn)(u32 *out, const u16 *index, const u32 *lut, unsigned n);
+typedef void (*pixel_convert16_fn)(u16 *out, const u16 *index, const u32 *lut, unsigned n);
+
+struct pixel_ops
+{
+    pixel_compose_fn compose;
+    pixel_convert32_fn convert32;
+    pixel_convert16_fn convert16;
+};
+
+/* 各内核需要的指令集 */
+static const enum simd_level pixel_simd[PIXEL_KERNEL_NUM] = {
+    [PIXEL_KERNEL_SCALAR] = SIMD_SCALAR,
+    [PIXEL_KERNEL_SSE2] = SIMD_SSE2,
+    [PIXEL_KERNEL_AVX2] = SIMD_AVX2,
+};
+
+#pragma region "标量"
+/**
+ * @brief  背景与精灵按优先级合成为调色板地址
+ * @param  bg 背景调色板地址，0 表示透明
+ * @param  spr 精灵像素，0 表示透明
+ * @retval 调色板地址
+ */
+static inline u8 pixel_mux(u8 bg, u8 spr)
+{
+    if(spr && (!bg || !(spr & PIXEL_SPR_BEHIND)))
+        return spr & PIXEL_SPR_ADDR;
+    return bg;
+}
+
+static void pixel_compose_scalar(u16 *out, const u8 *bg, const u8 *spr, const u16 *lut, unsigned n)
+{
+    for (unsigned x = 0; x < n; x++)
+        out[x] = lut[pixel_mux(bg[x], spr[x])];
+}
+
+static void pixel_convert32_scalar(u32 *out, const u16 *index, const u32 *lut, unsigned n)
+{
+    for (unsigned x = 0; x < n; x++)
+        out[x] = lut[index[x]];
+}
+
+static void pixel_convert16_scalar(u16 *out, const u16 *index, const u32 *lut, unsigned n)
+{
+    for (unsigned x = 0; x < n; x++)
+        out[x] = lut[index[x]];
+}
+#pragma endregion
+
+#if SIMD_X86
+#pragma region "SSE2"
+/* 16 个像素的优先级选择：精灵透明，或精灵在背景后且背景不透明时取背景 */
+SIMD_TARGET("sse2")
+static inline __m128i pixel_mux_sse2(__m128i bg, __m128i spr)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i behind = _mm_set1_epi8(PIXEL_SPR_BEHIND);
+    __m128i spr_clear = _mm_cmpeq_epi8(spr, zero);
+    __m128i bg_solid = _mm_andnot_si128(_mm_cmpeq_epi8(bg, zero), _mm_cmpeq_epi8(_mm_and_si128(spr, behind), behind));
+    __m128i use_bg = _mm_or_si128(spr_clear, bg_solid);
+    return _mm_or_si128(_mm_and_si128(use_bg, bg),
+                        _mm_andnot_si128(use_bg, _mm_and_si128(spr, _mm_set1_epi8(PIXEL_SPR_ADDR))));
+}
+
+/* SSE2 没有字节查表指令，查表逐像素进行，合成与写出按 128 位处理 */
+SIMD_TARGET("sse2")
+static void pixel_compose_sse2(u16 *out, const u8 *bg, const u8 *spr, const u16 *lut, unsigned n)
+{
+    unsigned x = 0;
+    for (; x + 16 <= n; x += 16)
+    {
+        u8 addr[16];
+        __m128i mux = pixel_mux_sse2(_mm_loadu_si128((const __m128i *)(bg + x)),
+                                     _mm_loadu_si128((const __m128i *)(spr + x)));
+        _mm_storeu_si128((__m128i *)addr, mux);
+        for (unsigned i = 0; i < 16; i += 8)
+            _mm_storeu_si128((__m128i *)(out + x + i),
+                             _mm_setr_epi16(lut[addr[i]], lut[addr[i + 1]], lut[addr[i + 2]], lut[addr[i + 3]],
+                                            lut[addr[i + 4]], lut[addr[i + 5]], lut[addr[i + 6]], lut[addr[i + 7]]));
+    }
+    pixel_compose_scalar(out + x, bg + x, spr + x, lut, n - x);
+}
+
+SIMD_TARGET("sse2")
+static void pixel_convert32_sse2(u32 *out, const u16 *index, const u32 *lut, unsigned n)
+{
+    unsigned x = 0;
+    for (; x + 4 <= n; x += 4)
+        _mm_storeu_si128((__m128i *)(out + x),
+                         _mm_setr_epi32(lut[index[x]], lut[index[x + 1]], lut[index[x + 2]], lut[index[x + 3]]));
+    pixel_convert32_scalar(out + x, index + x, lut, n - x);
+}
+
+SIMD_TARGET("sse2")
+static void pixel_convert16_sse2(u16 *out, const u16 *index, const u32 *lut, unsigned n)
+{
+    unsigned x = 0;
+    for (; x + 8 <= n; x += 8)
+        _mm_storeu_si128((__m128i *)(out + x),
+                         _mm_setr_epi16(lut[index[x]], lut[index[x + 1]], lut[index[x + 2]], lut[index[x + 3]],
+                                        lut[index[x + 4]], lut[index[x + 5]], lut[index[x + 6]], lut[index[x + 7]]));
+    pixel_convert16_scalar(out + x, index + x, lut, n - x);
+}
+#pragma endregion
+
+#pragma region "AVX2"
+SIMD_TARGET("avx2")
+static inline __m256i pixel_mux_avx2(__m256i bg, __m256i spr)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i behind = _mm256_set1_epi8(PIXEL_SPR_BEHIND);
+    __m256i spr_clear = _mm256_cmpeq_epi8(spr, zero);
+    __m256i bg_solid = _mm256_andnot_si256(_mm256_cmpeq_epi8(bg, zero),
+                                           _mm256_cmpeq_epi8(_mm256_and_si256(spr, behind), behind));
+    __m256i use_bg = _mm256_or_si256(spr_clear, bg_solid);
+    return _mm256_blendv_epi8(_mm256_and_si256(spr, _mm256_set1_epi8(PIXEL_SPR_ADDR)), bg, use_bg);
+}
+
+/**
+ * @brief  以字节查表指令查 32 项字节表
+ * @param  lo 表的前 16 项，两个 128 位通道相同
+ * @param  hi 表的后 16 项，两个 128 位通道相同
+ * @param  addr 下标 0-31
+ * @retval 查表结果
+ */
+SIMD_TARGET("avx2")
+static inline __m256i pixel_lookup32_avx2(__m256i lo, __m256i hi, __m256i addr)
+{
+    __m256i upper = _mm256_slli_epi16(addr, 3);  /* 下标 bit4 移到字节最高位作为选择条件 */
+    return _mm256_blendv_epi8(_mm256_shuffle_epi8(lo, addr), _mm256_shuffle_epi8(hi, addr), upper);
+}
+
+/* 一次合成 32 个像素，颜色下标的高低字节分别查表后交织为 16 位 */
+SIMD_TARGET("avx2")
+static void pixel_compose_avx2(u16 *out, const u8 *bg, const u8 *spr, const u16 *lut, unsigned n)
+{
+    u8 table[4][16];
+    for (unsigned i = 0; i < 0x20; i++)
+    {
+        table[i >> 4][i & 15] = lut[i];
+        table[2 + (i >> 4)][i & 15] = lut[i] >> 8;
+    }
+    const __m256i lo0 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)table[0]));
+    const __m256i lo1 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)table[1]));
+    const __m256i hi0 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)table[2]));
+    const __m256i hi1 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)table[3]));
+
+    unsigned x = 0;
+    for (; x + 32 <= n; x += 32)
+    {
+        __m256i mux = pixel_mux_avx2(_mm256_loadu_si256((const __m256i *)(bg + x)),
+                                     _mm256_loadu_si256((const __m256i *)(spr + x)));
+        __m256i lo = pixel_lookup32_avx2(lo0, lo1, mux);
+        __m256i hi = pixel_lookup32_avx2(hi0, hi1, mux);
+        /* 交织在各 128 位通道内进行，再按像素顺序重排通道 */
+        __m256i a = _mm256_unpacklo_epi8(lo, hi);
+        __m256i b = _mm256_unpackhi_epi8(lo, hi);
+        _mm256_storeu_si256((__m256i *)(out + x), _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i *)(out + x + 16), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+    pixel_compose_sse2(out + x, bg + x, spr + x, lut, n - x);
+}
+
+/* 8 个颜色下标零扩展后通过 gather 查表 */
+SIMD_TARGET("avx2")
+static void pixel_convert32_avx2(u32 *out, const u16 *index, const u32 *lut, unsigned n)
+{
+    unsigned x = 0;
+    for (; x + 8 <= n; x += 8)
+    {
+        __m256i addr = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(index + x)));
+        _mm256_storeu_si256((__m256i *)(out + x), _mm256_i32gather_epi32((const int *)lut, addr, 4));
+    }
+    pixel_convert32_scalar(out + x, index + x, lut, n - x);
+}
+
+/* 查表结果只有低 16 位有效，收窄后按像素顺序重排 64 位块 */
+SIMD_TARGET("avx2")
+static void pixel_convert16_avx2(u16 *out, const u16 *index, const u32 *lut, unsigned n)
+{
+    unsigned x = 0;
+    for (; x + 16 <= n; x += 16)
+    {
+        __m256i a = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(index + x)));
+        __m256i b = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(index + x + 8)));
+        a = _mm256_i32gather_epi32((const int *)lut, a, 4);
+        b = _mm256_i32gather_epi32((const int *)lut, b, 4);
+        _mm256_storeu_si256((__m256i *)(out + x), _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xD8));
+    }
+    pixel_convert16_scalar(out + x, index + x, lut, n - x);
+}
+#pragma endregion
+#endif
+
+static const struct pixel_ops pixel_ops_table[PIXEL_KERNEL_NUM] = {
+    [PIXEL_KERNEL_SCALAR] = { pixel_compose_scalar, pixel_convert32_scalar, pixel_convert16_scalar },
+#if SIMD_X86
+    [PIXEL_KERNEL_SSE2] = { pixel_compose_sse2, pixel_convert32_sse2, pixel_convert16_sse2 },
+    [PIXEL_KERNEL_AVX2] = { pixel_compose_avx2, pixel_convert32_avx2, pixel_convert16_avx2 },
+#endif
+};
+
+static enum pixel_kernel pixel_current = PIXEL_KERNEL_SCALAR;
+static const struct pixel_ops *pixel_impl = pixel_ops_table + PIXEL_KERNEL_SCALAR;
+
+/**
+ * @brief  判断当前 CPU 是否支持指定内核
+ * @param  kernel 内核
+ * @retval 1: 支持, 0: 不支持
+ */
+static int pixel_supported(enum pixel_kernel kernel)
+{
+    if(kernel < 0 || kernel >= PIXEL_KERNEL_NUM || pixel_ops_table[kernel].compose == NULL)
+        return 0;
+    return simd_supported(pixel_simd[kernel]);
+}
+
+/**
+ * @brief  指定像素内核
+ * @param  kernel 内核
+ * @retval RET_OK: 成功, RET_ERR: 当前 CPU 或编译器不支持该内核
+ */
+int pixel_select(enum pixel_kernel kernel)
+{
+    if(!pixel_supported(kernel))
+        return RET_ERR;
+    pixel_current = kernel;
+    pixel_impl = pixel_ops_table + kernel;
+    return RET_OK;
+}
+
+/**
+ * @brief  查询当前使用的像素内核
+ * @retval 内核
+ */
+enum pixel_kernel pixel_kernel(void)
+{
+    return pixel_current;
+}
+
+/**
+ * @brief  按 CPUID 选择可用的最快内核
+ * @retval 无
+ * @note 同一个二进制可在不支持 AVX2 的主机上运行。每次 \c ppu_init 都会调用，只在首次选择时记录。
+ */
+void pixel_init(void)
+{
+    static u8 logged;
+    for (int kernel = PIXEL_KERNEL_NUM - 1; kernel >= 0; kernel--)
+    {
+        if(pixel_select(kernel) == RET_OK)
+            break;
+    }
+    if(!logged)
+        LOG("pixel kernel: %s", simd_name(pixel_simd[pixel_current]));
+    logged = 1;
+}
+
+/**
+ * @brief  合成一行像素的颜色下标
+ * @param  out 输出的颜色下标
+ * @param  bg 背景调色板地址，0 表示透明
+ * @param  spr 精灵像素，低 5 位为调色板地址，0 表示透明
+ * @param  lut 调色板地址到 9 位颜色下标的查找表，32 项
+ * @param  n 像素数
+ * @retval 无
+ * @note 输入需已按 PPUMASK 屏蔽，0 号精灵命中由调用者检测。
+ */
+void pixel_compose(u16 *out, const u8 *bg, const u8 *spr, const u16 *lut, unsigned n)
+{
+    pixel_impl->compose(out, bg, spr, lut, n);
+}
+
+/**
+ * @brief  颜色下标转换为输出格式
+ * @param  out 输出像素
+ * @param  index 9 位颜色下标
+ * @param  lut 颜色下标到输出颜色的查找表，512 项
+ * @param  n 像素数
+ * @param  bytes 每像素字节数：2 或 4
+ * @retval 无
+ */
+void pixel_convert(void *out, const u16 *index, const u32 *lut, unsigned n, u8 bytes)
+{
+    if(bytes == sizeof(u16))
+        pixel_impl->convert16(out, index, lut, n);
+    else
+        pixel_impl->convert32(out, index, lut, n);
+}
@@ -0,0 +1,1597 @@
+#include <string.h>
+#include <pthread.h>
+#include "log.h"
+#include "core/nes/ppu.h"
+#include "core/nes/chr.h"
+#include "core/nes/cpu.h"
+#include "core/nes/palette.h"
+#include "core/nes/pixel.h"
+#include "core/nes/sched.h"
+
+#pragma region "寄存器"
+enum ppu_reg_map
+{
+    PPU_REG_CTRL = 0,
+    PPU_REG_MASK = 1,
+    PPU_REG_STATUS = 2,
+    PPU_REG_OAMADDR = 3,
+    PPU_REG_OAMDATA = 4,
+    PPU_REG_SCROLL = 5,
+    PPU_REG_ADDR = 6,
+    PPU_REG_DATA = 7,
+};
+
+#define CTRL_INC32      0x04
+#define CTRL_SPR_TABLE  0x08
+#define CTRL_BG_TABLE   0x10
+#define CTRL_SPR_16     0x20
+#define CTRL_NMI        0x80
+
+#define MASK_GREY       0x01
+#define MASK_BG_LEFT    0x02
+#define MASK_SPR_LEFT   0x04
+#define MASK_BG         0x08
+#define MASK_SPR        0x10
+#define MASK_EMPHASIS   0xE0
+#define MASK_RENDER     (MASK_BG | MASK_SPR)
+
+#define STATUS_OVERFLOW 0x20
+#define STATUS_HIT      0x40
+#define STATUS_VBLANK   0x80
+
+/* 精灵行缓冲：低 5 位为调色板地址，另有优先级与 0 号精灵标记 */
+#define SPR_PIXEL       PIXEL_SPR_ADDR
+#define SPR_BEHIND      PIXEL_SPR_BEHIND
+#define SPR_ZERO        0x40
+
+#define SPR_NUM         64
+#define SPR_LINE_MAX    8   /* 硬件每行最多显示的精灵数 */
+
+struct ppu
+{
+    /* 寄存器 */
+    u8 ctrl;
+    u8 mask;
+    u8 status;
+    u8 oam_addr;
+    u16 v;
+    u16 t;
+    u8 x;
+    u8 w;
+    u8 read_buffer;
+    u8 latch;
+
+    /* 存储 */
+    u8 ciram[0x1000];
+    u8 palette[0x20];
+    u8 oam[0x100];
+    u8 chr_ram[PPU_CHR_RAM_SIZE];
+    u8 *chr[PPU_CHR_BANK_NUM];
+    struct chr_bank *tiles[PPU_CHR_BANK_NUM];       /* 渲染只读取解码后的图块 */
+    struct chr_bank tiles_private[PPU_CHR_BANK_NUM]; /* 未缓存的 bank 映射时在此解码 */
+    u8 chr_writable;
+    u8 *nt[4];
+
+    /* 时序：已执行的点数及当前所处的扫描线与点 */
+    enum region region;     /* 追赶时锁存的制式，副本使用日志提交时的制式 */
+    u64 dots;
+    u16 line;
+    u16 dot;
+    u8 odd;
+
+    /* 渲染 */
+    u16 line_v;     /* 本行像素 0 所在图块对应的 v */
+    u16 hit_dot;    /* 本行 0 号精灵命中的点，0 表示无 */
+    u8 bg_line[PPU_WIDTH + 16];
+    u8 spr_line[PPU_WIDTH];
+
+    /* 精灵评估：OAM 的 Y 坐标或精灵高度改变后重建各扫描线的精灵列表 */
+    u8 spr_list[PPU_HEIGHT][SPR_NUM];   /* 覆盖该行的精灵编号，按 OAM 顺序 */
+    u8 spr_count[PPU_HEIGHT];
+    u8 spr_height;      /* 列表对应的精灵高度，0 表示需要重建 */
+    u8 spr_limit;       /* 每行绘制的精灵数上限，溢出标志仍按 8 个判断 */
+    u16 index[2][PPU_WIDTH * PPU_HEIGHT];   /* 渲染输出：9 位颜色下标 */
+    u32 frame[2][PPU_WIDTH * PPU_HEIGHT];   /* 未指定输出画面时使用的内部缓冲 */
+    struct ppu_surface surface[2];          /* 帧完成后颜色下标转换到的画面 */
+    u8 back;
+    u8 converted;   /* 最近完成的一帧已转换到输出画面 */
+
+    /* 画面变化检测 */
+    u8 dirty;       /* 上次交换后显存、OAM 或调色板内容有变化 */
+    u8 frame_dirty; /* 最近完成的一帧与前一帧可能不同 */
+    u32 hash;       /* 帧开始时的渲染状态及帧内寄存器写入的摘要 */
+    u32 frame_hash;
+
+    /* 仅时序模式：不输出像素，只保留 0 号精灵命中、溢出与 NMI */
+    u8 skip;
+    u8 skip_next;
+    u8 frame_skipped;
+
+    u8 replica;     /* 工作线程中按写入日志重放的副本，不产生中断也不修改调度器 */
+};
+
+static struct ppu __ppu;
+static sched_id ppu_sched_id = RET_ERR;
+static event_id ppu_vblank_event = RET_ERR;
+
+/* 流水线写入日志：记录影响渲染的操作及其发生时的点数 */
+#define PPU_LOG_MAX_NUM 0x4000
+
+enum ppu_log_kind
+{
+    PPU_LOG_READ = 0,
+    PPU_LOG_WRITE,
+    PPU_LOG_OAM,
+    PPU_LOG_MIRROR,
+    PPU_LOG_CHR,
+    PPU_LOG_SURFACE,
+    PPU_LOG_SKIP,
+    PPU_LOG_INVALIDATE,
+    PPU_LOG_SPR_LIMIT,
+    PPU_LOG_SYNC,
+};
+
+struct ppu_log_entry
+{
+    u64 dots;
+    u8 kind;
+    u8 reg;         /* 寄存器、OAM 地址或 CHR 槽位 */
+    u8 data;
+    u8 *bank;
+    struct ppu_surface surface;
+};
+
+/* 最近完成的一帧 */
+struct ppu_frame_info
+{
+    struct ppu_surface surface;
+    const u16 *index;
+    u8 dirty;
+    u8 skipped;
+    u8 converted;
+};
+
+static struct ppu_pipeline
+{
+    enum ppu_pipeline_mode mode;
+    struct ppu replica;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct ppu_log_entry log[2][PPU_LOG_MAX_NUM];
+    u32 len[2];
+    enum region region[2];  /* 各份日志记录时的制式，交给工作线程时锁存 */
+    u8 fill;            /* 模拟线程正在写入的日志 */
+    u8 busy;            /* 工作线程正在重放另一份日志 */
+    u8 quit;
+    struct ppu_frame_info published;    /* 工作线程写入 */
+    struct ppu_frame_info presented;    /* 提交时从 published 复制，模拟线程读取 */
+    u32 mismatches;
+} pipeline = {
+    .mode = PPU_PIPELINE_OFF,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void ppu_pipeline_flush(void);
+
+#define PPU_HASH_SEED 2166136261u
+#define PPU_HASH_PRIME 16777619u
+#pragma endregion
+
+#pragma region "变化检测"
+static inline void ppu_hash(struct ppu *p, u32 data)
+{
+    p->hash = (p->hash ^ data) * PPU_HASH_PRIME;
+}
+
+/**
+ * @brief  记录影响渲染的状态修改
+ * @param  p PPU
+ * @param  kind 修改类型
+ * @param  data 修改后的值
+ * @retval 无
+ * @note 只记录渲染期间（可见行与 pre-render 线）的修改及其所在的扫描线，
+ *       vblank 期间的修改由帧开始时的状态摘要覆盖，每帧相同的分屏不会被视为变化。
+ *       修改在行内的位置随 CPU 指令对齐抖动，不计入摘要。
+ */
+static void ppu_hash_write(struct ppu *p, u32 kind, u32 data)
+{
+    if(p->line >= PPU_HEIGHT && p->line != region_timings[p->region].lines - 1)
+        return;
+    ppu_hash(p, ((u32)p->line << 16) | kind);
+    ppu_hash(p, data);
+}
+
+/**
+ * @brief  帧开始时记录渲染状态
+ * @param  p PPU
+ * @retval 无
+ */
+static void ppu_hash_begin(struct ppu *p)
+{
+    p->hash = PPU_HASH_SEED;
+    ppu_hash(p, p->ctrl | (p->mask << 8) | (p->x << 16));
+    ppu_hash(p, p->t);
+    for (unsigned i = 0; i < PPU_CHR_BANK_NUM; i++)
+        ppu_hash(p, (u32)(uintptr_t)p->chr[i]);
+    for (unsigned i = 0; i < 4; i++)
+        ppu_hash(p, (u32)(uintptr_t)p->nt[i]);
+}
+
+/**
+ * @brief  帧完成时判断画面是否变化
+ * @param  p PPU
+ * @retval 无
+ */
+static void ppu_hash_end(struct ppu *p)
+{
+    p->frame_dirty = p->dirty || p->hash != p->frame_hash;
+    p->frame_hash = p->hash;
+    p->dirty = 0;
+}
+#pragma endregion
+
+#pragma region "显存"
+static inline u8 ppu_palette_index(u16 addr)
+{
+    addr &= 0x1F;
+    if((addr & 0x13) == 0x10)
+        addr &= ~0x10;
+    return addr;
+}
+
+static inline u8 ppu_chr_read(struct ppu *p, u16 addr)
+{
+    return p->chr[addr >> 10][addr & (CHR_BANK_SIZE - 1)];
+}
+
+/**
+ * @brief  获取解码后的图块行
+ * @param  p PPU
+ * @param  addr 图块行在图案表中的地址（低平面）
+ * @retval 8 个像素，每像素 0-3
+ */
+static inline const u8 *ppu_chr_row(struct ppu *p, u16 addr)
+{
+    return p->tiles[addr >> 10]->tile[(addr >> 4) & (CHR_BANK_TILES - 1)][addr & 7];
+}
+
+/**
+ * @brief  写 CHR-RAM 并更新解码缓存
+ * @param  p PPU
+ * @param  addr 图案表地址
+ * @param  data 写入数据
+ * @retval 无
+ * @note 同一 bank 可能映射到多个槽位，私有解码缓存需逐个更新。
+ */
+static void ppu_chr_write(struct ppu *p, u16 addr, u8 data)
+{
+    u8 slot = addr >> 10;
+    u16 offset = addr & (CHR_BANK_SIZE - 1);
+    u8 *bank = p->chr[slot];
+    struct chr_bank *cached = p->replica ? NULL : chr_cache_lookup(bank);
+
+    if(bank[offset] == data)
+        return;
+    p->dirty = 1;
+    bank[offset] = data;
+    if(cached)
+        chr_decode_row(cached, bank, offset);
+    for (u8 i = 0; i < PPU_CHR_BANK_NUM; i++)
+    {
+        if(p->chr[i] == bank && p->tiles[i] == p->tiles_private + i)
+            chr_decode_row(p->tiles[i], bank, offset);
+    }
+}
+
+static u8 ppu_vram_read(struct ppu *p, u16 addr)
+{
+    addr &= 0x3FFF;
+    if(addr < 0x2000)
+        return ppu_chr_read(p, addr);
+    if(addr < 0x3F00)
+        return p->nt[(addr >> 10) & 3][addr & 0x3FF];
+    return p->palette[ppu_palette_index(addr)];
+}
+
+static void ppu_vram_write(struct ppu *p, u16 addr, u8 data)
+{
+    addr &= 0x3FFF;
+    if(addr < 0x2000)
+    {
+        if(TEST_BIT(p->chr_writable, addr >> 10))
+            ppu_chr_write(p, addr, data);
+    }
+    else if(addr < 0x3F00)
+    {
+        u8 *nt = p->nt[(addr >> 10) & 3] + (addr & 0x3FF);
+        p->dirty |= *nt != data;
+        *nt = data;
+    }
+    else
+    {
+        u8 *color = p->palette + ppu_palette_index(addr);
+        p->dirty |= *color != (data & 0x3F);
+        *color = data & 0x3F;
+    }
+}
+
+/**
+ * @brief  v 的粗略 X 增加 n 个图块
+ * @param  v 当前地址
+ * @param  n 图块数
+ * @retval 新地址
+ * @note 越过 32 个图块时切换水平名称表。
+ */
+static inline u16 ppu_coarse_add(u16 v, unsigned n)
+{
+    unsigned coarse = (v & 0x1F) + n;
+    v ^= ((coarse >> 5) & 1) << 10;
+    return (v & ~0x1F) | (coarse & 0x1F);
+}
+
+static inline u16 ppu_increment_y(u16 v)
+{
+    if((v & 0x7000) != 0x7000)
+        return v + 0x1000;
+    v &= ~0x7000;
+    u16 y = (v & 0x3E0) >> 5;
+    if(y == 29)
+    {
+        y = 0;
+        v ^= 0x800;
+    }
+    else if(y == 31)
+        y = 0;
+    else
+        y++;
+    return (v & ~0x3E0) | (y << 5);
+}
+#pragma endregion
+
+#pragma region "渲染"
+/**
+ * @brief  取背景图块的一行
+ * @param  p PPU
+ * @param  v 图块地址
+ * @param  row 解码后的图块行
+ * @retval 图块所用调色板
+ */
+static inline u8 ppu_fetch_tile(struct ppu *p, u16 v, const u8 **row)
+{
+    u8 *nt = p->nt[(v >> 10) & 3];
+    u8 tile = nt[v & 0x3FF];
+    u8 attr = nt[0x3C0 | ((v >> 4) & 0x38) | ((v >> 2) & 0x07)];
+    *row = ppu_chr_row(p, ((p->ctrl & CTRL_BG_TABLE) << 8) | (tile << 4) | ((v >> 12) & 7));
+    return (attr >> (((v >> 4) & 4) | (v & 2))) & 3;
+}
+
+/**
+ * @brief  计算单个背景像素
+ * @param  p PPU
+ * @param  x 像素横坐标
+ * @retval 背景调色板地址，0 表示透明
+ * @note 逐点路径使用，仅在行内寄存器被修改时调用。
+ */
+static u8 ppu_bg_pixel(struct ppu *p, unsigned x)
+{
+    const u8 *row;
+    if(!(p->mask & MASK_BG) || (x < 8 && !(p->mask & MASK_BG_LEFT)))
+        return 0;
+    unsigned fx = x + p->x;
+    u8 pal = ppu_fetch_tile(p, ppu_coarse_add(p->line_v, fx >> 3), &row);
+    u8 pix = row[fx & 7];
+    return pix ? (pal << 2) | pix : 0;
+}
+
+/**
+ * @brief  按图块解码整行背景到行缓冲
+ * @param  p PPU
+ * @retval 无
+ * @note 行缓冲从图块边界开始，输出时按精细 X 偏移读取。
+ */
+static void ppu_fetch_bg_line(struct ppu *p)
+{
+    u8 *out = p->bg_line;
+    for (unsigned i = 0; i < 33; i++, out += 8)
+    {
+        const u8 *row;
+        u8 pal = ppu_fetch_tile(p, ppu_coarse_add(p->line_v, i), &row) << 2;
+        for (unsigned j = 0; j < 8; j++)
+            out[j] = row[j] ? pal | row[j] : 0;
+    }
+}
+
+/**
+ * @brief  按 Y 坐标把精灵分到各扫描线的列表
+ * @param  p PPU
+ * @param  height 精灵高度
+ * @retval 无
+ * @note OAM 改变后首次评估时调用，代替每行扫描全部 64 个精灵。
+ */
+static void ppu_build_spr_lists(struct ppu *p, unsigned height)
+{
+    memset(p->spr_count, 0, sizeof(p->spr_count));
+    for (unsigned i = 0; i < SPR_NUM; i++)
+    {
+        unsigned top = p->oam[i * 4] + 1;
+        for (unsigned line = top; line < top + height && line < PPU_HEIGHT; line++)
+            p->spr_list[line][p->spr_count[line]++] = i;
+    }
+    p->spr_height = height;
+}
+
+/**
+ * @brief  精灵评估并绘制到精灵行缓冲
+ * @param  p PPU
+ * @param  line 当前扫描线
+ * @retval 1: 本行包含 0 号精灵, 0: 不包含
+ * @note 只处理本行列表中的精灵。超过 8 个时设置溢出标志，绘制数量受 \c spr_limit 限制。
+ */
+static int ppu_fetch_spr_line(struct ppu *p, unsigned line)
+{
+    unsigned height = (p->ctrl & CTRL_SPR_16) ? 16 : 8;
+    int zero = 0;
+
+    memset(p->spr_line, 0, sizeof(p->spr_line));
+    if(line == 0)
+        return 0;
+    if(p->spr_height != height)
+        ppu_build_spr_lists(p, height);
+    if(p->spr_count[line] > SPR_LINE_MAX)
+        p->status |= STATUS_OVERFLOW;
+
+    unsigned count = MIN(p->spr_count[line], p->spr_limit);
+    for (unsigned n = 0; n < count; n++)
+    {
+        unsigned i = p->spr_list[line][n];
+        u8 *spr = p->oam + i * 4;
+        unsigned row = line - 1 - spr[0];
+        u8 tile = spr[1], attr = spr[2];
+        u16 addr;
+        if(attr & 0x80)
+            row = height - 1 - row;
+        if(height == 16)
+            addr = ((tile & 1) << 12) | ((tile & 0xFE) << 4) | ((row & 8) << 1) | (row & 7);
+        else
+            addr = ((p->ctrl & CTRL_SPR_TABLE) << 9) | (tile << 4) | row;
+        const u8 *pixels = ppu_chr_row(p, addr);
+        u8 flags = 0x10 | ((attr & 3) << 2) | ((attr & 0x20) ? SPR_BEHIND : 0) | (i == 0 ? SPR_ZERO : 0);
+        zero |= i == 0;
+
+        for (unsigned j = 0; j < 8; j++)
+        {
+            unsigned x = spr[3] + j;
+            if(x >= PPU_WIDTH)
+                break;
+            u8 pix = pixels[(attr & 0x40) ? 7 - j : j];
+            if(pix && !p->spr_line[x])
+                p->spr_line[x] = flags | pix;
+        }
+    }
+    return zero;
+}
+
+/**
+ * @brief  计算调色板地址对应的颜色下标
+ * @param  p PPU
+ * @param  addr 调色板地址
+ * @retval 含强调位的 9 位颜色下标
+ * @note PAL 与 Dendy 的 PPU 红绿强调位互换。
+ */
+static inline u16 ppu_color(struct ppu *p, u8 addr)
+{
+    u8 color = p->palette[addr] & ((p->mask & MASK_GREY) ? 0x30 : 0x3F);
+    u8 emphasis = (p->mask & MASK_EMPHASIS) >> 5;
+    if(p->region != REGION_NTSC)
+        emphasis = (emphasis & 4) | ((emphasis & 1) << 1) | ((emphasis & 2) >> 1);
+    return PALETTE_INDEX(emphasis, color);
+}
+
+static void ppu_surface_internal(struct ppu *p, u8 index)
+{
+    p->surface[index] = (struct ppu_surface){
+        .data = p->frame[index],
+        .pitch = PPU_WIDTH * sizeof(u32),
+        .bytes = sizeof(u32),
+        .top = 0,
+        .height = PPU_HEIGHT,
+    };
+}
+
+/**
+ * @brief  合成单个像素并写入帧缓冲
+ * @param  p PPU
+ * @param  x 像素横坐标
+ * @param  bg 背景调色板地址
+ * @retval 无
+ */
+static inline void ppu_put_pixel(struct ppu *p, unsigned x, u8 bg)
+{
+    u8 spr = 0;
+    if((p->mask & MASK_SPR) && (x >= 8 || (p->mask & MASK_SPR_LEFT)))
+        spr = p->spr_line[x];
+
+    if((spr & SPR_ZERO) && bg && x != 255 && !p->hit_dot && !(p->status & STATUS_HIT))
+        p->hit_dot = x + 1;
+
+    u8 addr = (spr && (!bg || !(spr & SPR_BEHIND))) ? (spr & SPR_PIXEL) : bg;
+    p->index[p->back][p->line * PPU_WIDTH + x] = ppu_color(p, addr);
+}
+
+/**
+ * @brief  只检测一段像素内的 0 号精灵命中
+ * @param  p PPU
+ * @param  from 起始像素
+ * @param  to 结束像素（不含）
+ * @retval 无
+ * @note 仅时序模式使用，只计算与 0 号精灵重叠处的背景像素。
+ */
+static void ppu_find_hit(struct ppu *p, unsigned from, unsigned to)
+{
+    if((p->mask & MASK_RENDER) != MASK_RENDER || p->hit_dot || (p->status & STATUS_HIT))
+        return;
+    for (unsigned x = from; x < to && x < PPU_WIDTH - 1; x++)
+    {
+        if(!(p->spr_line[x] & SPR_ZERO) || (x < 8 && !(p->mask & MASK_SPR_LEFT)))
+            continue;
+        if(ppu_bg_pixel(p, x))
+        {
+            p->hit_dot = x + 1;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief  整行渲染
+ * @param  p PPU
+ * @retval 无
+ * @note 常规路径：按图块解码背景，评估精灵后由像素合成内核一次输出整行。
+ */
+static void ppu_render_line(struct ppu *p)
+{
+    static const u8 transparent[PPU_WIDTH];
+    u16 *out = p->index[p->back] + p->line * PPU_WIDTH;
+
+    p->line_v = p->v;
+    p->hit_dot = 0;
+    if(!(p->mask & MASK_RENDER))
+    {
+        u16 color = ppu_color(p, 0);
+        memset(p->spr_line, 0, sizeof(p->spr_line));
+        if(p->skip)
+            return;
+        for (unsigned x = 0; x < PPU_WIDTH; x++)
+            out[x] = color;
+        return;
+    }
+
+    if(p->skip)
+    {
+        if(ppu_fetch_spr_line(p, p->line))
+            ppu_find_hit(p, 0, PPU_WIDTH);
+        return;
+    }
+    ppu_fetch_bg_line(p);
+    int zero = ppu_fetch_spr_line(p, p->line);
+    const u8 *bg = (p->mask & MASK_BG) ? p->bg_line + p->x : transparent;
+    const u8 *spr = (p->mask & MASK_SPR) ? p->spr_line : transparent;
+
+    /* 左侧 8 像素的屏蔽由逐点合成处理，其余像素交给内核 */
+    unsigned left = 0;
+    if((p->mask & (MASK_BG_LEFT | MASK_SPR_LEFT)) != (MASK_BG_LEFT | MASK_SPR_LEFT))
+    {
+        for (; left < 8; left++)
+            ppu_put_pixel(p, left, (p->mask & MASK_BG_LEFT) ? bg[left] : 0);
+    }
+    if(zero && spr != transparent && !p->hit_dot && !(p->status & STATUS_HIT))
+    {
+        for (unsigned x = left; x < PPU_WIDTH - 1; x++)
+        {
+            if((spr[x] & SPR_ZERO) && bg[x])
+            {
+                p->hit_dot = x + 1;
+                break;
+            }
+        }
+    }
+
+    u16 lut[0x20];
+    for (unsigned i = 0; i < 0x20; i++)
+        lut[i] = ppu_color(p, i);
+    pixel_compose(out + left, bg + left, spr + left, lut, PPU_WIDTH - left);
+}
+
+/**
+ * @brief  颜色下标转换到输出画面
+ * @param  s 输出画面
+ * @param  index 一帧的颜色下标
+ * @retval 无
+ * @note 每个呈现的帧只转换一次，跳过或重复的帧不需要转换。
+ */
+static void ppu_convert(const struct ppu_surface *s, const u16 *index)
+{
+    const u32 *lut = palette_lut();
+    index += s->top * PPU_WIDTH;
+    if(s->pitch == PPU_WIDTH * s->bytes)
+    {
+        pixel_convert(s->data, index, lut, s->height * PPU_WIDTH, s->bytes);
+        return;
+    }
+    for (unsigned line = 0; line < s->height; line++)
+        pixel_convert((u8 *)s->data + line * s->pitch, index + line * PPU_WIDTH, lut, PPU_WIDTH, s->bytes);
+}
+
+/**
+ * @brief  逐点渲染当前行的一段像素
+ * @param  p PPU
+ * @param  from 起始像素
+ * @param  to 结束像素（不含）
+ * @retval 无
+ * @note 行内寄存器被修改时的回退路径，使用修改后的状态重绘剩余像素。
+ */
+static void ppu_render_dots(struct ppu *p, unsigned from, unsigned to)
+{
+    p->hit_dot = 0;
+    if(p->skip)
+        ppu_find_hit(p, from, to);
+    else
+    {
+        for (unsigned x = from; x < to; x++)
+            ppu_put_pixel(p, x, ppu_bg_pixel(p, x));
+    }
+    if(p->hit_dot && p->hit_dot <= p->dot)
+    {
+        p->status |= STATUS_HIT;
+        p->hit_dot = 0;
+    }
+}
+
+/**
+ * @brief  判断当前是否位于可见行的输出阶段
+ * @param  p PPU
+ * @retval 1: 是, 0: 否
+ */
+static inline int ppu_mid_line(struct ppu *p)
+{
+    return p->line < PPU_HEIGHT && p->dot >= 1 && p->dot <= PPU_WIDTH;
+}
+
+/**
+ * @brief  当前帧已经输出的扫描线数
+ * @param  p PPU
+ * @retval 行数
+ */
+static inline unsigned ppu_rendered_lines(struct ppu *p)
+{
+    return p->line < PPU_HEIGHT ? p->line + (p->dot >= 1) : 0;
+}
+
+/**
+ * @brief  副本完成一帧时发布画面信息
+ * @param  p PPU 副本
+ * @retval 无
+ * @note 在工作线程中调用，模拟线程只在工作线程空闲时读取。
+ */
+static void ppu_pipeline_publish(struct ppu *p)
+{
+    pipeline.published.surface = p->surface[p->back ^ 1];
+    pipeline.published.index = p->index[p->back ^ 1];
+    pipeline.published.converted = 0;
+    pipeline.published.dirty = p->frame_dirty;
+    pipeline.published.skipped = p->frame_skipped;
+}
+#pragma endregion
+
+#pragma region "时序"
+/**
+ * @brief  计算本行下一个需要处理的点
+ * @param  p PPU
+ * @param  prerender pre-render 线编号
+ * @param  odd_skip 是否支持奇数帧跳点
+ * @retval 点序号
+ */
+FORCE_INLINE u16 ppu_next_dot(struct ppu *p, const u16 prerender, const u8 odd_skip)
+{
+    u16 dot = p->dot;
+    if(dot < 1)
+        return 1;
+    if(p->hit_dot > dot)
+        return p->hit_dot;
+    if(dot < 256)
+        return 256;
+    if(dot < 257)
+        return 257;
+    if(p->line == prerender)
+    {
+        if(dot < 280)
+            return 280;
+        if(odd_skip && dot < 339)
+            return 339;
+    }
+    return REGION_DOTS_PER_LINE;
+}
+
+/**
+ * @brief  PPU 追赶到指定的点
+ * @param  p PPU
+ * @param  target 目标点数
+ * @retval 无
+ * @note 由各制式实例化，参数均为编译期常量。
+ */
+FORCE_INLINE void ppu_advance(struct ppu *p, u64 target, const u16 lines,
+                              const u16 vblank_line, const u8 odd_skip, const u8 ppu_div)
+{
+    const u16 prerender = lines - 1;
+    while (p->dots < target)
+    {
+        u16 next = ppu_next_dot(p, prerender, odd_skip);
+        u64 step = MIN((u64)(next - p->dot), target - p->dots);
+        p->dot += step;
+        p->dots += step;
+        if(p->dot != next)
+            break;
+
+        int rendering = (p->mask & MASK_RENDER) && (p->line < PPU_HEIGHT || p->line == prerender);
+        switch (next)
+        {
+        case 1:
+            if(p->line < PPU_HEIGHT)
+                ppu_render_line(p);
+            else if(p->line == vblank_line)
+            {
+                p->status |= STATUS_VBLANK;
+                p->back ^= 1;
+                p->converted = 0;
+                ppu_surface_internal(p, p->back);
+                ppu_hash_end(p);
+                /* 跳过的帧没有画面，之后第一帧必须视为有变化 */
+                p->frame_skipped = p->skip;
+                p->dirty |= p->skip;
+                if(p->replica)
+                    ppu_pipeline_publish(p);
+                else if(p->ctrl & CTRL_NMI)
+                    cpu_nmi();
+            }
+            else if(p->line == prerender)
+            {
+                p->status &= ~(STATUS_VBLANK | STATUS_HIT | STATUS_OVERFLOW);
+                p->skip = p->skip_next;
+                ppu_hash_begin(p);
+            }
+            break;
+        case 256:
+            if(rendering)
+                p->v = ppu_increment_y(p->v);
+            break;
+        case 257:
+            if(rendering)
+                p->v = (p->v & ~0x41F) | (p->t & 0x41F);
+            break;
+        case 280:
+            if(rendering)
+                p->v = (p->v & 0x41F) | (p->t & ~0x41F);
+            break;
+        case 339:
+            if(rendering && p->odd)
+            {
+                /* 奇数帧 pre-render 线少一个点，帧结束与 vblank 同步提前 */
+                p->dot++;
+                if(p->replica)
+                    break;
+                /* 追赶到帧末时目标随帧末一起提前，停在下一帧第 0 点 */
+                if(target == g_sched.frame_end / ppu_div)
+                    target--;
+                g_sched.frame_end -= ppu_div;
+                sched_event_reschedule(ppu_vblank_event, sched_event_time(ppu_vblank_event) - ppu_div);
+            }
+            break;
+        case REGION_DOTS_PER_LINE:
+            p->dot = 0;
+            if(++p->line >= lines)
+            {
+                p->line = 0;
+                p->odd ^= 1;
+            }
+            break;
+        default:
+            break;
+        }
+        if(p->hit_dot && p->hit_dot <= p->dot)
+        {
+            p->status |= STATUS_HIT;
+            p->hit_dot = 0;
+        }
+    }
+}
+
+#define PPU_ADVANCE_DEFINE(ID, name, hz, cpu_div, ppu_div, lines, vblank_line, odd_skip, apu_quarter) \
+static void ppu_advance_##name(struct ppu *p, u64 target) \
+{ \
+    ppu_advance(p, target, lines, vblank_line, odd_skip, ppu_div); \
+}
+REGION_LIST(PPU_ADVANCE_DEFINE)
+#undef PPU_ADVANCE_DEFINE
+
+#define PPU_ADVANCE_ENTRY(ID, name, ...) [REGION_##ID] = ppu_advance_##name,
+static void (*const ppu_advance_fn[REGION_NUM])(struct ppu *p, u64 target) = {
+    REGION_LIST(PPU_ADVANCE_ENTRY)
+};
+#undef PPU_ADVANCE_ENTRY
+
+static void ppu_sync(u64 until)
+{
+    __ppu.region = g_sched.region;
+    ppu_advance_fn[g_sched.region](&__ppu, until / g_sched.timing->ppu_div);
+}
+
+/**
+ * @brief  vblank 事件：追赶 PPU 以按时产生 NMI
+ * @param  when 事件时刻
+ * @retval 无
+ */
+static void ppu_vblank_fire(u64 when)
+{
+    ppu_sync(when);
+    sched_event_schedule(ppu_vblank_event, when + g_sched.timing->frame_cycles);
+}
+#pragma endregion
+
+#pragma region "状态修改"
+/* 以下函数只修改传入的 PPU，模拟线程与工作线程中的副本共用 */
+
+static void ppu_apply_oam(struct ppu *p, u8 addr, u8 data)
+{
+    if(p->oam[addr] == data)
+        return;
+    p->dirty = 1;
+    p->oam[addr] = data;
+    if((addr & 3) == 0)
+        p->spr_height = 0;
+}
+
+static void ppu_apply_spr_limit(struct ppu *p, u8 limit)
+{
+    p->dirty |= p->spr_limit != limit;
+    p->spr_limit = limit;
+}
+
+static u8 ppu_reg_read(struct ppu *p, u8 reg)
+{
+    switch (reg)
+    {
+    case PPU_REG_STATUS:
+        p->latch = (p->status & 0xE0) | (p->latch & 0x1F);
+        p->status &= ~STATUS_VBLANK;
+        p->w = 0;
+        break;
+    case PPU_REG_OAMDATA:
+        p->latch = p->oam[p->oam_addr];
+        break;
+    case PPU_REG_DATA:
+        if((p->v & 0x3FFF) >= 0x3F00)
+        {
+            p->latch = ppu_vram_read(p, p->v);
+            p->read_buffer = ppu_vram_read(p, p->v - 0x1000);
+        }
+        else
+        {
+            p->latch = p->read_buffer;
+            p->read_buffer = ppu_vram_read(p, p->v);
+        }
+        p->v += (p->ctrl & CTRL_INC32) ? 32 : 1;
+        break;
+    default:
+        break;
+    }
+    return p->latch;
+}
+
+static void ppu_reg_write(struct ppu *p, u8 reg, u8 data)
+{
+    int mid_line = ppu_mid_line(p), changed = 1;
+
+    p->latch = data;
+    switch (reg)
+    {
+    case PPU_REG_CTRL:
+        changed = data != p->ctrl;
+        if((data & CTRL_NMI) && !(p->ctrl & CTRL_NMI) && (p->status & STATUS_VBLANK) && !p->replica)
+            cpu_nmi();
+        p->ctrl = data;
+        p->t = (p->t & ~0xC00) | ((data & 3) << 10);
+        break;
+    case PPU_REG_MASK:
+        changed = data != p->mask;
+        p->mask = data;
+        break;
+    case PPU_REG_OAMADDR:
+        p->oam_addr = data;
+        return;
+    case PPU_REG_OAMDATA:
+        ppu_apply_oam(p, p->oam_addr++, data);
+        return;
+    case PPU_REG_SCROLL:
+        if(!p->w)
+        {
+            p->t = (p->t & ~0x1F) | (data >> 3);
+            p->x = data & 7;
+        }
+        else
+            p->t = (p->t & ~0x73E0) | ((data & 7) << 12) | ((data & 0xF8) << 2);
+        p->w ^= 1;
+        break;
+    case PPU_REG_ADDR:
+        if(!p->w)
+        {
+            p->t = (p->t & 0xFF) | ((data & 0x3F) << 8);
+        }
+        else
+        {
+            p->t = (p->t & 0xFF00) | data;
+            p->v = p->t;
+            if(mid_line)
+            {
+                unsigned x = p->dot - 1;
+                p->line_v = ppu_coarse_add(p->v, 64 - ((x + p->x) >> 3));
+            }
+        }
+        p->w ^= 1;
+        break;
+    case PPU_REG_DATA:
+        ppu_vram_write(p, p->v, data);
+        p->v += (p->ctrl & CTRL_INC32) ? 32 : 1;
+        return;
+    default:
+        return;
+    }
+    if(changed)
+        ppu_hash_write(p, reg, data);
+
+    /* 行内修改了影响渲染的寄存器，剩余像素回退到逐点路径重绘 */
+    if(mid_line)
+        ppu_render_dots(p, p->dot - 1, PPU_WIDTH);
+}
+
+static void ppu_apply_mirroring(struct ppu *p, enum ppu_mirror mirror)
+{
+    static const u8 map[][4] = {
+        [PPU_MIRROR_HORIZONTAL] = { 0, 0, 1, 1 },
+        [PPU_MIRROR_VERTICAL]   = { 0, 1, 0, 1 },
+        [PPU_MIRROR_SINGLE0]    = { 0, 0, 0, 0 },
+        [PPU_MIRROR_SINGLE1]    = { 1, 1, 1, 1 },
+        [PPU_MIRROR_FOUR]       = { 0, 1, 2, 3 },
+    };
+    for (int i = 0; i < 4; i++)
+        p->nt[i] = p->ciram + map[mirror][i] * 0x400;
+    ppu_hash_write(p, 0x100, mirror);
+    if(ppu_mid_line(p))
+        ppu_render_dots(p, p->dot - 1, PPU_WIDTH);
+}
+
+/**
+ * @brief  设置槽位的 bank 及其解码结果
+ * @param  p PPU
+ * @param  slot 槽位
+ * @param  bank bank 数据
+ * @param  writable 是否可写
+ * @retval 无
+ * @note 副本中指向模拟线程 CHR-RAM 的 bank 改为指向副本自己的 CHR-RAM。可写 bank 只能位于
+ *       CHR-RAM 内，副本与模拟线程共享的只有只读的 CHR-ROM。
+ *       共享的解码缓存只由模拟线程更新，副本中的可写 bank 总是在私有缓存中解码。
+ */
+static void ppu_bind_chr(struct ppu *p, u8 slot, u8 *bank, u8 writable)
+{
+    LOG_ASSERT(!writable || (bank >= __ppu.chr_ram && bank < __ppu.chr_ram + sizeof(__ppu.chr_ram)));
+    if(p->replica && bank >= __ppu.chr_ram && bank < __ppu.chr_ram + sizeof(__ppu.chr_ram))
+        bank = p->chr_ram + (bank - __ppu.chr_ram);
+    p->chr[slot] = bank;
+    p->tiles[slot] = (p->replica && writable) ? NULL : chr_cache_lookup(bank);
+    if(p->tiles[slot] == NULL)
+    {
+        p->tiles[slot] = p->tiles_private + slot;
+        chr_decode_bank(p->tiles[slot], bank);
+    }
+    if(writable)
+        SET_BIT(p->chr_writable, slot);
+    else
+        CLEAR_BIT(p->chr_writable, slot);
+}
+
+static void ppu_apply_chr(struct ppu *p, u8 slot, u8 *bank, u8 writable)
+{
+    ppu_bind_chr(p, slot, bank, writable);
+    ppu_hash_write(p, 0x200 | slot, (u32)(uintptr_t)bank);
+    if(ppu_mid_line(p))
+        ppu_render_dots(p, p->dot - 1, PPU_WIDTH);
+}
+
+static void ppu_apply_surface(struct ppu *p, const struct ppu_surface *surface)
+{
+    if(surface)
+        p->surface[p->back] = *surface;
+    else
+        ppu_surface_internal(p, p->back);
+    LOG_ASSERT(p->surface[p->back].bytes == 2 || p->surface[p->back].bytes == 4);
+}
+
+static void ppu_apply_skip(struct ppu *p, u8 skip)
+{
+    p->skip_next = skip;
+    if(ppu_rendered_lines(p) == 0)
+        p->skip = skip;
+}
+
+static void ppu_apply_invalidate(struct ppu *p)
+{
+    p->dirty = 1;
+    p->frame_dirty = 1;
+}
+#pragma endregion
+
+#pragma region "流水线"
+/**
+ * @brief  追加一条日志
+ * @param  p PPU
+ * @param  kind 日志类型
+ * @retval 日志项，未开启流水线时为 NULL
+ * @note 日志写满时提前交给工作线程。
+ */
+static struct ppu_log_entry *ppu_log(struct ppu *p, enum ppu_log_kind kind)
+{
+    if(pipeline.mode == PPU_PIPELINE_OFF || p->replica)
+        return NULL;
+    if(pipeline.len[pipeline.fill] == PPU_LOG_MAX_NUM)
+        ppu_pipeline_flush();
+    struct ppu_log_entry *e = pipeline.log[pipeline.fill] + pipeline.len[pipeline.fill]++;
+    e->dots = p->dots;
+    e->kind = kind;
+    return e;
+}
+
+static void ppu_log_reg(struct ppu *p, enum ppu_log_kind kind, u8 reg, u8 data)
+{
+    struct ppu_log_entry *e = ppu_log(p, kind);
+    if(e)
+    {
+        e->reg = reg;
+        e->data = data;
+    }
+}
+
+/**
+ * @brief  在副本上重放一份日志
+ * @param  p PPU 副本
+ * @param  log 日志
+ * @param  len 日志项数
+ * @retval 无
+ */
+static void ppu_replay(struct ppu *p, const struct ppu_log_entry *log, u32 len)
+{
+    void (*advance)(struct ppu *p, u64 target) = ppu_advance_fn[p->region];
+    for (u32 i = 0; i < len; i++)
+    {
+        const struct ppu_log_entry *e = log + i;
+        advance(p, e->dots);
+        switch (e->kind)
+        {
+        case PPU_LOG_READ:
+            ppu_reg_read(p, e->reg);
+            break;
+        case PPU_LOG_WRITE:
+            ppu_reg_write(p, e->reg, e->data);
+            break;
+        case PPU_LOG_OAM:
+            ppu_apply_oam(p, e->reg, e->data);
+            break;
+        case PPU_LOG_MIRROR:
+            ppu_apply_mirroring(p, e->data);
+            break;
+        case PPU_LOG_CHR:
+            ppu_apply_chr(p, e->reg, e->bank, e->data);
+            break;
+        case PPU_LOG_SURFACE:
+            ppu_apply_surface(p, e->surface.data ? &e->surface : NULL);
+            break;
+        case PPU_LOG_SKIP:
+            ppu_apply_skip(p, e->data);
+            break;
+        case PPU_LOG_INVALIDATE:
+            ppu_apply_invalidate(p);
+            break;
+        case PPU_LOG_SPR_LIMIT:
+            ppu_apply_spr_limit(p, e->data);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static void *ppu_pipeline_worker(void *arg)
+{
+    UNUSED(arg);
+    pthread_mutex_lock(&pipeline.lock);
+    while (1)
+    {
+        while (!pipeline.busy && !pipeline.quit)
+            pthread_cond_wait(&pipeline.cond, &pipeline.lock);
+        if(pipeline.quit)
+            break;
+        u8 index = pipeline.fill ^ 1;
+        pipeline.replica.region = pipeline.region[index];
+        pthread_mutex_unlock(&pipeline.lock);
+
+        ppu_replay(&pipeline.replica, pipeline.log[index], pipeline.len[index]);
+
+        pthread_mutex_lock(&pipeline.lock);
+        pipeline.len[index] = 0;
+        pipeline.busy = 0;
+        pthread_cond_broadcast(&pipeline.cond);
+    }
+    pthread_mutex_unlock(&pipeline.lock);
+    return NULL;
+}
+
+static void ppu_pipeline_wait(void)
+{
+    pthread_mutex_lock(&pipeline.lock);
+    while (pipeline.busy)
+        pthread_cond_wait(&pipeline.cond, &pipeline.lock);
+    pthread_mutex_unlock(&pipeline.lock);
+}
+
+/**
+ * @brief  把正在写入的日志交给工作线程
+ * @retval 无
+ * @note 先等待工作线程处理完上一份日志。日志随当前制式一起交出，
+ *       之后切换制式不影响工作线程重放已提交的日志。
+ */
+static void ppu_pipeline_flush(void)
+{
+    pthread_mutex_lock(&pipeline.lock);
+    while (pipeline.busy)
+        pthread_cond_wait(&pipeline.cond, &pipeline.lock);
+    pipeline.region[pipeline.fill] = g_sched.region;
+    pipeline.fill ^= 1;
+    pipeline.busy = 1;
+    pthread_cond_broadcast(&pipeline.cond);
+    pthread_mutex_unlock(&pipeline.lock);
+}
+
+/**
+ * @brief  以模拟线程的 PPU 为起点建立副本
+ * @retval 无
+ * @note 工作线程空闲时调用。
+ */
+static void ppu_pipeline_clone(void)
+{
+    struct ppu *src = &__ppu, *dst = &pipeline.replica;
+
+    memcpy(dst, src, sizeof(*dst));
+    dst->replica = 1;
+    for (u8 i = 0; i < PPU_CHR_BANK_NUM; i++)
+        ppu_bind_chr(dst, i, src->chr[i], TEST_BIT(src->chr_writable, i));
+    for (int i = 0; i < 4; i++)
+        dst->nt[i] = dst->ciram + (src->nt[i] - src->ciram);
+    ppu_surface_internal(dst, 0);
+    ppu_surface_internal(dst, 1);
+    pipeline.len[0] = pipeline.len[1] = 0;
+    pipeline.published = (struct ppu_frame_info){ dst->surface[dst->back ^ 1], dst->index[dst->back ^ 1], 1, 0, 0 };
+    pipeline.presented = pipeline.published;
+}
+
+/**
+ * @brief  校验模式下比较两条路径完成的同一帧
+ * @retval 无
+ */
+static void ppu_pipeline_validate(void)
+{
+    struct ppu *p = &__ppu;
+    const u16 *a = p->index[p->back ^ 1];
+    const u16 *b = pipeline.presented.index;
+
+    if(p->frame_skipped || pipeline.presented.skipped)
+        return;
+    for (unsigned line = 0; line < PPU_HEIGHT; line++)
+    {
+        if(memcmp(a + line * PPU_WIDTH, b + line * PPU_WIDTH, PPU_WIDTH * sizeof(u16)))
+        {
+            LOG_L(LOG_ERROR, "pipeline mismatch at line %u", line);
+            pipeline.mismatches++;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief  开启或关闭流水线渲染
+ * @param  mode 流水线模式
+ * @retval RET_OK: 成功, RET_ERR: 无法创建工作线程
+ * @note 开启后模拟线程中的 PPU 只维护时序，像素由工作线程按写入日志在副本上生成，
+ *       画面比模拟晚一帧。校验模式下两条路径都生成像素并逐帧比较。
+ */
+int ppu_pipeline(enum ppu_pipeline_mode mode)
+{
+    struct ppu *p = &__ppu;
+
+    if(pipeline.mode != PPU_PIPELINE_OFF)
+    {
+        ppu_pipeline_wait();
+        pthread_mutex_lock(&pipeline.lock);
+        pipeline.quit = 1;
+        pthread_cond_broadcast(&pipeline.cond);
+        pthread_mutex_unlock(&pipeline.lock);
+        pthread_join(pipeline.thread, NULL);
+        pipeline.mode = PPU_PIPELINE_OFF;
+        p->skip = p->skip_next = pipeline.replica.skip_next;
+        ppu_apply_invalidate(p);
+    }
+    if(mode == PPU_PIPELINE_OFF)
+        return RET_OK;
+
+    if(ppu_sched_id != RET_ERR)
+        sched_sync(ppu_sched_id);
+    ppu_pipeline_clone();
+    pipeline.quit = 0;
+    pipeline.busy = 0;
+    pipeline.mismatches = 0;
+    if(pthread_create(&pipeline.thread, NULL, ppu_pipeline_worker, NULL))
+        return RET_ERR;
+    pipeline.mode = mode;
+    if(mode == PPU_PIPELINE_ON)
+        p->skip = p->skip_next = 1;
+    return RET_OK;
+}
+
+/**
+ * @brief  查询流水线模式
+ * @retval 流水线模式
+ */
+enum ppu_pipeline_mode ppu_pipeline_mode(void)
+{
+    return pipeline.mode;
+}
+
+/**
+ * @brief  一帧模拟结束后提交日志
+ * @retval 无
+ * @note 等待工作线程完成上一帧后交出本帧日志并立即返回，之后 \c ppu_frame 等接口返回上一帧；
+ *       校验模式下等待本帧完成并与模拟线程的结果比较。
+ */
+void ppu_pipeline_submit(void)
+{
+    struct ppu *p = &__ppu;
+    if(pipeline.mode == PPU_PIPELINE_OFF)
+        return;
+    sched_sync_frame(ppu_sched_id);
+    ppu_log(p, PPU_LOG_SYNC);
+    ppu_pipeline_wait();
+    pipeline.presented = pipeline.published;
+    ppu_pipeline_flush();
+    if(pipeline.mode != PPU_PIPELINE_VALIDATE)
+        return;
+    ppu_pipeline_wait();
+    pipeline.presented = pipeline.published;
+    ppu_pipeline_validate();
+}
+
+/**
+ * @brief  查询校验模式下两条路径结果不一致的帧数
+ * @retval 帧数
+ */
+u32 ppu_pipeline_mismatches(void)
+{
+    return pipeline.mismatches;
+}
+#pragma endregion
+
+#pragma region "总线"
+/* CPU 批次内的访问总在帧末之前；两帧之间的访问不越过帧末，写入对下一帧第 0 行生效 */
+static u8 ppu_read(u16 addr)
+{
+    struct ppu *p = &__ppu;
+    sched_sync_frame(ppu_sched_id);
+    if((addr & 7) == PPU_REG_STATUS || (addr & 7) == PPU_REG_DATA)
+        ppu_log_reg(p, PPU_LOG_READ, addr & 7, 0);
+    return ppu_reg_read(p, addr & 7);
+}
+
+static void ppu_write(u16 addr, u8 data)
+{
+    struct ppu *p = &__ppu;
+    sched_sync_frame(ppu_sched_id);
+    ppu_log_reg(p, PPU_LOG_WRITE, addr & 7, data);
+    ppu_reg_write(p, addr & 7, data);
+}
+#pragma endregion
+
+#pragma region "PPU"
+static char ppu_name[] = "NES_PPU_2C02";
+static char ppu_vblank_name[] = "PPU vblank";
+
+/**
+ * @brief  设置名称表镜像方式
+ * @param  mirror 镜像方式
+ * @retval 无
+ * @note 行内切换时剩余像素使用新的映射重绘，两帧之间切换时从下一帧第 0 行生效。
+ */
+void ppu_set_mirroring(enum ppu_mirror mirror)
+{
+    struct ppu *p = &__ppu;
+    if(ppu_sched_id != RET_ERR)
+        sched_sync_frame(ppu_sched_id);
+    ppu_log_reg(p, PPU_LOG_MIRROR, 0, mirror);
+    ppu_apply_mirroring(p, mirror);
+}
+
+/**
+ * @brief  映射 1KB 图案表 bank
+ * @param  slot PPU 地址空间中的 1KB 槽位 0-7
+ * @param  bank bank 数据，NULL 表示恢复内部 CHR-RAM
+ * @param  writable 是否可写，可写的 bank 必须位于 \c ppu_chr_ram 内
+ * @retval 无
+ * @note 供 mapper 切换 bank 使用。已缓存的 bank 只交换指针，否则在槽位私有缓存中解码。
+ *       两帧之间调用时 PPU 只追赶到帧边界，下一帧第 0 行即使用新 bank。
+ *       流水线副本有自己的 CHR-RAM 并按日志重放写入，mapper 自带的可写存储无法与其同步。
+ */
+void ppu_map_chr(u8 slot, u8 *bank, u8 writable)
+{
+    struct ppu *p = &__ppu;
+    LOG_ASSERT(slot < PPU_CHR_BANK_NUM);
+    if(ppu_sched_id != RET_ERR)
+        sched_sync_frame(ppu_sched_id);
+    if(bank == NULL)
+    {
+        bank = p->chr_ram + slot * CHR_BANK_SIZE;
+        writable = 1;
+    }
+    struct ppu_log_entry *e = ppu_log(p, PPU_LOG_CHR);
+    if(e)
+    {
+        e->reg = slot;
+        e->data = writable;
+        e->bank = bank;
+    }
+    ppu_apply_chr(p, slot, bank, writable);
+}
+
+/**
+ * @brief  获取 PPU 内部 CHR-RAM
+ * @retval \c PPU_CHR_RAM_SIZE 字节的 CHR-RAM
+ * @note 带 CHR-RAM 的 mapper 在其中切换 bank，以可写方式传给 \c ppu_map_chr。
+ */
+u8 *ppu_chr_ram(void)
+{
+    return __ppu.chr_ram;
+}
+
+/**
+ * @brief  OAM DMA，从 CPU 地址空间复制一页到 OAM
+ * @param  page 源地址高字节
+ * @retval 无
+ * @note CPU 被暂停 513 个周期。由 APU 在 $4014 写入时调用。
+ */
+void ppu_oam_dma(u8 page)
+{
+    struct ppu *p = &__ppu;
+    sched_sync(ppu_sched_id);
+    for (unsigned i = 0; i < 0x100; i++)
+    {
+        u8 addr = p->oam_addr + i;
+        u8 data = bus_read_direct((page << 8) | i);
+        ppu_log_reg(p, PPU_LOG_OAM, addr, data);
+        ppu_apply_oam(p, addr, data);
+    }
+    g_sched.clock += 513 * g_sched.timing->cpu_div;
+}
+
+/**
+ * @brief  指定正在渲染的帧的输出画面
+ * @param  surface 输出画面，NULL 表示使用内部缓冲
+ * @retval 无
+ * @note 在帧完成前调用，帧完成后颜色下标在取用时才转换到该画面，之后恢复为内部缓冲。
+ *       画面需保持有效到该帧被 \c ppu_frame_surface 返回之后。
+ */
+void ppu_set_surface(const struct ppu_surface *surface)
+{
+    struct ppu *p = &__ppu;
+    sched_sync_frame(ppu_sched_id);
+    struct ppu_log_entry *e = ppu_log(p, PPU_LOG_SURFACE);
+    if(e)
+    {
+        e->surface = surface ? *surface : (struct ppu_surface){ 0 };
+        return;
+    }
+    ppu_apply_surface(p, surface);
+}
+
+/**
+ * @brief  设置仅时序模式
+ * @param  skip 1: 不输出像素, 0: 正常渲染
+ * @retval 无
+ * @note 在两帧之间（\c sched_run_frame 之前）调用时对即将运行的一帧生效；帧内调用时若已输出
+ *       扫描线则从下一帧开始生效，保证每帧要么完整渲染要么完整跳过。
+ *       0 号精灵命中、精灵溢出与 NMI 的时序不受影响。
+ */
+void ppu_set_skip(int skip)
+{
+    struct ppu *p = &__ppu;
+    sched_sync_frame(ppu_sched_id);
+    ppu_log_reg(p, PPU_LOG_SKIP, 0, !!skip);
+    if(pipeline.mode != PPU_PIPELINE_ON)
+        ppu_apply_skip(p, !!skip);
+}
+
+/**
+ * @brief  设置是否限制每行 8 个精灵
+ * @param  enable 1: 与硬件一致, 0: 绘制每行全部精灵以消除闪烁
+ * @retval 无
+ * @note 精灵溢出标志不受影响。
+ */
+void ppu_set_sprite_limit(int enable)
+{
+    struct ppu *p = &__ppu;
+    u8 limit = enable ? SPR_LINE_MAX : SPR_NUM;
+    if(ppu_sched_id != RET_ERR)
+        sched_sync_frame(ppu_sched_id);
+    ppu_log_reg(p, PPU_LOG_SPR_LIMIT, 0, limit);
+    ppu_apply_spr_limit(p, limit);
+}
+
+/**
+ * @brief  查询最近完成的一帧是否被跳过
+ * @retval 1: 跳过，画面内容无效, 0: 正常渲染
+ */
+int ppu_frame_skipped()
+{
+    if(pipeline.mode != PPU_PIPELINE_OFF)
+        return pipeline.presented.skipped;
+    return __ppu.frame_skipped;
+}
+
+/**
+ * @brief  查询最近完成的一帧是否可能与前一帧不同
+ * @retval 1: 可能不同, 0: 与前一帧相同
+ * @note 比较的是产生画面的输入，因而结果是保守的。
+ */
+int ppu_frame_dirty()
+{
+    if(pipeline.mode != PPU_PIPELINE_OFF)
+        return pipeline.presented.dirty;
+    return __ppu.frame_dirty;
+}
+
+/**
+ * @brief  强制下一帧视为有变化
+ * @retval 无
+ * @note 调色板、输出格式等 PPU 之外影响画面的设置改变时调用。
+ */
+void ppu_invalidate()
+{
+    struct ppu *p = &__ppu;
+    ppu_log_reg(p, PPU_LOG_INVALIDATE, 0, 0);
+    ppu_apply_invalidate(p);
+}
+
+/**
+ * @brief  获取最近完成的一帧的输出画面
+ * @retval 输出画面
+ * @note 首次调用时把颜色下标转换为输出格式。开启流水线时为工作线程最近完成的一帧。
+ */
+const struct ppu_surface *ppu_frame_surface()
+{
+    struct ppu *p = &__ppu;
+    if(pipeline.mode != PPU_PIPELINE_OFF)
+    {
+        struct ppu_frame_info *f = &pipeline.presented;
+        if(!f->converted && !f->skipped)
+            ppu_convert(&f->surface, f->index);
+        f->converted = 1;
+        return &f->surface;
+    }
+    if(!p->converted && !p->frame_skipped)
+        ppu_convert(p->surface + (p->back ^ 1), p->index[p->back ^ 1]);
+    p->converted = 1;
+    return p->surface + (p->back ^ 1);
+}
+
+/**
+ * @brief  获取最近完成的一帧的颜色下标
+ * @retval 256x240 的 9 位颜色下标，低 6 位为 NES 颜色，高 3 位为强调位
+ * @note 与输出格式无关，可用于画面摘要与截图。
+ */
+const u16 *ppu_frame_index()
+{
+    if(pipeline.mode != PPU_PIPELINE_OFF)
+        return pipeline.presented.index;
+    return __ppu.index[__ppu.back ^ 1];
+}
+
+/**
+ * @brief  获取最近完成的一帧
+ * @retval 256x240 的像素，格式与所用的输出画面一致
+ * @note 帧在进入 vblank 时完成并交换。指定了外部输出画面时返回该画面。
+ */
+const u32 *ppu_frame()
+{
+    return ppu_frame_surface()->data;
+}
+
+/**
+ * @brief  PPU 复位
+ * @retval 无
+ * @note 调度器复位后调用，重新安排 vblank 事件。开启流水线时副本随之重建。
+ */
+void ppu_reset()
+{
+    struct ppu *p = &__ppu;
+    const struct region_timing *timing = g_sched.timing;
+
+    p->ctrl = 0;
+    p->mask = 0;
+    p->status = 0;
+    p->w = 0;
+    p->read_buffer = 0;
+    p->region = g_sched.region;
+    p->dots = g_sched.clock / timing->ppu_div;
+    p->line = 0;
+    p->dot = 0;
+    p->odd = 0;
+    p->hit_dot = 0;
+    p->skip = p->skip_next;
+    p->frame_skipped = 0;
+    ppu_surface_internal(p, 0);
+    ppu_surface_internal(p, 1);
+    ppu_apply_invalidate(p);
+
+    sched_event_reschedule(ppu_vblank_event,
+        (p->dots + (u64)timing->vblank_line * REGION_DOTS_PER_LINE + 1) * timing->ppu_div);
+
+    if(pipeline.mode != PPU_PIPELINE_OFF)
+    {
+        u8 skip = pipeline.replica.skip_next;
+        ppu_pipeline_wait();
+        ppu_pipeline_clone();
+        pipeline.replica.skip = pipeline.replica.skip_next = skip;
+    }
+}
+
+/**
+ * @brief  PPU初始化
+ * @retval 返回 \c RET_ERR 表示失败，其他表示成功
+ * @note 流水线被关闭。
+ */
+dev_id ppu_init()
+{
+    static dev_id ppu_id = RET_ERR;
+    struct ppu *p = &__ppu;
+
+    ppu_pipeline(PPU_PIPELINE_OFF);
+    if(ppu_id != RET_ERR)
+        bus_remove(ppu_id);
+    sched_remove(ppu_sched_id);
+    sched_event_remove(ppu_vblank_event);
+    ppu_sched_id = RET_ERR;
+
+    memset(p, 0, sizeof(*p));
+    p->spr_limit = SPR_LINE_MAX;
+    chr_cache_reset();
+    pixel_init();
+    chr_cache_attach(p->chr_ram, sizeof(p->chr_ram));
+    for (u8 i = 0; i < PPU_CHR_BANK_NUM; i++)
+        ppu_map_chr(i, NULL, 1);
+    ppu_set_mirroring(PPU_MIRROR_HORIZONTAL);
+
+    ppu_id = bus_register(ppu_name, PPU_MAP_BASE, PPU_MAP_SIZE, ppu_read, ppu_write);
+    ppu_sched_id = sched_register(ppu_name, ppu_sync);
+    ppu_vblank_event = sched_event_register(ppu_vblank_name, ppu_vblank_fire);
+    if(ppu_id == RET_ERR || ppu_sched_id == RET_ERR || ppu_vblank_event == RET_ERR)
+        return RET_ERR;
+
+    ppu_reset();
+    return ppu_id;
+}
+#pragma endregion
@@ -33,7 +33,7 @@ static void ram_write(u16 addr, u8 data)
 /**
  * @brief  RAM初始化
  * @retval 无
- * @note 
+ * @note 四个镜像均登记为可直接读取。
  */
 dev_id ram_init()
 {
@@ -41,6 +41,8 @@ dev_id ram_init()
     if(ram_id != RET_ERR)
         bus_remove(ram_id);
     ram_id = bus_register(ram_name, RAM_MAP_BASE, RAM_MAP_SIZE, ram_read, ram_write);
+    for (u16 addr = RAM_MAP_BASE; addr < RAM_MAP_BASE + RAM_MAP_SIZE; addr += RAM_BUFSIZE)
+        bus_map_direct(addr, RAM_BUFSIZE, ram);
     memset(ram, 0, sizeof(ram));
     return ram_id;
 }
\ No newline at end of file
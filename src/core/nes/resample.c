@@ -0,0 +1,172 @@
+#include <math.h>
+#include <string.h>
+#include "log.h"
+#include "core/nes/resample.h"
+
+#define RESAMPLE_CHUNK 256      /* 每次处理的输入采样数 */
+#define RESAMPLE_SHIFT 15       /* 系数的小数位数 */
+#define RESAMPLE_CUTOFF 0.9     /* 相对输入奈奎斯特频率，与合成缓冲的带宽一致 */
+
+/* 处理一段输入：work 前 RESAMPLE_TAPS - 1 个为历史采样，每个输入采样输出 ratio 个立体声采样 */
+typedef void (*resample_block_fn)(s16 *out, const s16 *work, unsigned n, const struct resample *r);
+
+#pragma region "标量"
+static void resample_block_scalar(s16 *out, const s16 *work, unsigned n, const struct resample *r)
+{
+    for (unsigned i = 0; i < n; i++)
+    {
+        const s16 *x = work + i;
+        for (unsigned p = 0; p < r->ratio; p++)
+        {
+            s32 acc = 0;
+            for (int k = 0; k < RESAMPLE_TAPS; k++)
+                acc += x[k] * r->kernel[p][k];
+            acc = (acc + (1 << (RESAMPLE_SHIFT - 1))) >> RESAMPLE_SHIFT;
+            if(acc > INT16_MAX)
+                acc = INT16_MAX;
+            else if(acc < INT16_MIN)
+                acc = INT16_MIN;
+            out[0] = out[1] = acc;
+            out += 2;
+        }
+    }
+}
+#pragma endregion
+
+#if SIMD_X86
+#pragma region "SSE2"
+/* 四个相位的部分和横向相加、舍入并收窄，按左右声道展开为 8 个采样 */
+SIMD_TARGET("sse2")
+static inline __m128i resample_reduce_sse2(__m128i a0, __m128i a1, __m128i a2, __m128i a3)
+{
+    __m128i s0 = _mm_add_epi32(_mm_unpacklo_epi32(a0, a1), _mm_unpackhi_epi32(a0, a1));
+    __m128i s1 = _mm_add_epi32(_mm_unpacklo_epi32(a2, a3), _mm_unpackhi_epi32(a2, a3));
+    __m128i sum = _mm_add_epi32(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1));
+    sum = _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(1 << (RESAMPLE_SHIFT - 1))), RESAMPLE_SHIFT);
+    sum = _mm_packs_epi32(sum, sum);
+    return _mm_unpacklo_epi16(sum, sum);
+}
+
+SIMD_TARGET("sse2")
+static void resample_block_sse2(s16 *out, const s16 *work, unsigned n, const struct resample *r)
+{
+    const __m128i *k = (const __m128i *)r->kernel;
+    s16 tmp[RESAMPLE_MAX_RATIO * 2];
+    for (unsigned i = 0; i < n; i++)
+    {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(work + i));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(work + i + 8));
+        __m128i a[RESAMPLE_MAX_RATIO];
+        for (int p = 0; p < RESAMPLE_MAX_RATIO; p++)
+            a[p] = _mm_add_epi32(_mm_madd_epi16(lo, k[p * 2]), _mm_madd_epi16(hi, k[p * 2 + 1]));
+        _mm_storeu_si128((__m128i *)tmp, resample_reduce_sse2(a[0], a[1], a[2], a[3]));
+        memcpy(out, tmp, r->ratio * 2 * sizeof(s16));
+        out += r->ratio * 2;
+    }
+}
+#pragma endregion
+
+#pragma region "AVX2"
+SIMD_TARGET("avx2")
+static inline __m128i resample_fold_avx2(__m256i a)
+{
+    return _mm_add_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+}
+
+SIMD_TARGET("avx2")
+static void resample_block_avx2(s16 *out, const s16 *work, unsigned n, const struct resample *r)
+{
+    const __m256i *k = (const __m256i *)r->kernel;
+    s16 tmp[RESAMPLE_MAX_RATIO * 2];
+    for (unsigned i = 0; i < n; i++)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(work + i));
+        __m128i a0 = resample_fold_avx2(_mm256_madd_epi16(x, k[0]));
+        __m128i a1 = resample_fold_avx2(_mm256_madd_epi16(x, k[1]));
+        __m128i a2 = resample_fold_avx2(_mm256_madd_epi16(x, k[2]));
+        __m128i a3 = resample_fold_avx2(_mm256_madd_epi16(x, k[3]));
+        _mm_storeu_si128((__m128i *)tmp, resample_reduce_sse2(a0, a1, a2, a3));
+        memcpy(out, tmp, r->ratio * 2 * sizeof(s16));
+        out += r->ratio * 2;
+    }
+}
+#pragma endregion
+#endif
+
+static const resample_block_fn resample_block_table[SIMD_LEVEL_NUM] = {
+    [SIMD_SCALAR] = resample_block_scalar,
+#if SIMD_X86
+    [SIMD_SSE2] = resample_block_sse2,
+    [SIMD_AVX2] = resample_block_avx2,
+#endif
+};
+
+/**
+ * @brief  初始化升采样器
+ * @param  r 升采样器
+ * @param  ratio 升采样倍数 1-RESAMPLE_MAX_RATIO
+ * @retval 无
+ * @note 第 p 相输出位于最新输入之前 8 - p / ratio 个采样处，系数为 Blackman 窗 sinc，每相归一化。
+ *       使用当前 CPU 支持的最高指令集。
+ */
+void resample_init(struct resample *r, unsigned ratio)
+{
+    LOG_ASSERT(ratio >= 1 && ratio <= RESAMPLE_MAX_RATIO);
+    memset(r, 0, sizeof(*r));
+    r->ratio = ratio;
+    r->level = simd_best();
+    for (unsigned p = 0; p < ratio; p++)
+    {
+        double tap[RESAMPLE_TAPS], sum = 0;
+        for (int k = 0; k < RESAMPLE_TAPS; k++)
+        {
+            double t = RESAMPLE_TAPS / 2 - 1 - k + (double)p / ratio;
+            double x = M_PI * RESAMPLE_CUTOFF * t;
+            double sinc = x == 0 ? 1 : sin(x) / x;
+            double w = 0.42 + 0.5 * cos(2 * M_PI * t / RESAMPLE_TAPS) + 0.08 * cos(4 * M_PI * t / RESAMPLE_TAPS);
+            tap[k] = sinc * w;
+            sum += tap[k];
+        }
+        for (int k = 0; k < RESAMPLE_TAPS; k++)
+            r->kernel[p][k] = (s16)lrint(tap[k] * ((1 << RESAMPLE_SHIFT) - 1) / sum);
+    }
+}
+
+/**
+ * @brief  指定升采样使用的指令集
+ * @param  r 升采样器
+ * @param  level 指令集
+ * @retval RET_OK: 成功, RET_ERR: 当前 CPU 或编译器不支持该指令集
+ */
+int resample_select(struct resample *r, enum simd_level level)
+{
+    if(level < 0 || level >= SIMD_LEVEL_NUM || resample_block_table[level] == NULL || !simd_supported(level))
+        return RET_ERR;
+    r->level = level;
+    return RET_OK;
+}
+
+/**
+ * @brief  升采样
+ * @param  r 升采样器
+ * @param  out 输出，左右声道交错，容纳 n * ratio 个立体声采样
+ * @param  in 单声道输入
+ * @param  n 输入采样数
+ * @retval 输出的立体声采样数
+ * @note 按 \c resample_select 选择的指令集运行，各实现结果逐位相同。
+ */
+unsigned resample_run(struct resample *r, s16 *out, const s16 *in, unsigned n)
+{
+    s16 work[RESAMPLE_TAPS - 1 + RESAMPLE_CHUNK];
+    resample_block_fn block = resample_block_table[r->level];
+    for (unsigned done = 0; done < n; )
+    {
+        unsigned m = MIN(n - done, RESAMPLE_CHUNK);
+        memcpy(work, r->history, sizeof(r->history));
+        memcpy(work + RESAMPLE_TAPS - 1, in + done, m * sizeof(s16));
+        block(out + done * r->ratio * 2, work, m, r);
+        memcpy(r->history, work + m, sizeof(r->history));
+        done += m;
+    }
+    return n * r->ratio;
+}
@@ -0,0 +1,384 @@
+#include <string.h>
+#include "log.h"
+#include "core/nes/sched.h"
+#include "core/nes/cpu.h"
+
+#define SCHED_DEV_MAX_NUM 8
+#define SCHED_EVENT_MAX_NUM 32
+
+struct sched g_sched = { .region = REGION_NTSC, .timing = region_timings };
+
+#define REGION_TIMING(ID, _name, hz, _cpu_div, _ppu_div, _lines, _vblank_line, _odd_skip, _apu_quarter) \
+    [REGION_##ID] = { \
+        .name = #ID, \
+        .master_hz = hz, \
+        .cpu_div = _cpu_div, \
+        .ppu_div = _ppu_div, \
+        .lines = _lines, \
+        .vblank_line = _vblank_line, \
+        .odd_skip = _odd_skip, \
+        .apu_quarter = _apu_quarter, \
+        .frame_cycles = REGION_FRAME_CYCLES(_ppu_div, _lines), \
+        .fps = (double)hz / REGION_FRAME_CYCLES(_ppu_div, _lines), \
+    },
+const struct region_timing region_timings[REGION_NUM] = {
+    REGION_LIST(REGION_TIMING)
+};
+#undef REGION_TIMING
+
+static struct sched_device
+{
+    char *name;
+    sync_fn sync;
+} dev[SCHED_DEV_MAX_NUM];
+
+static struct sched_event
+{
+    char *name;
+    event_fn fire;
+    u64 when;   /* 事件触发的主时钟周期 */
+    int slot;   /* 在堆中的下标，-1 表示未排队 */
+} event[SCHED_EVENT_MAX_NUM];
+
+/* 以触发时刻为键的二叉小顶堆，保存 event_id */
+static event_id heap[SCHED_EVENT_MAX_NUM];
+static int heap_len;
+
+#pragma region "事件堆"
+static void heap_place(int slot, event_id id)
+{
+    heap[slot] = id;
+    event[id].slot = slot;
+}
+
+static void heap_sift_up(int slot)
+{
+    event_id id = heap[slot];
+    while (slot > 0)
+    {
+        int parent = (slot - 1) / 2;
+        if(event[heap[parent]].when <= event[id].when)
+            break;
+        heap_place(slot, heap[parent]);
+        slot = parent;
+    }
+    heap_place(slot, id);
+}
+
+static void heap_sift_down(int slot)
+{
+    event_id id = heap[slot];
+    while (1)
+    {
+        int child = slot * 2 + 1;
+        if(child >= heap_len)
+            break;
+        if(child + 1 < heap_len && event[heap[child + 1]].when < event[heap[child]].when)
+            child++;
+        if(event[id].when <= event[heap[child]].when)
+            break;
+        heap_place(slot, heap[child]);
+        slot = child;
+    }
+    heap_place(slot, id);
+}
+
+static void heap_remove(int slot)
+{
+    event_id id = heap[slot];
+    event[id].slot = -1;
+    if(--heap_len == slot)
+        return;
+    id = heap[heap_len];
+    heap_place(slot, id);
+    heap_sift_down(slot);
+    heap_sift_up(event[id].slot);
+}
+#pragma endregion
+
+/**
+ * @brief  更新缓存的下一个事件时刻
+ * @retval 无
+ * @note CPU 批次只与 \c g_sched.deadline 比较，不检查具体事件。
+ */
+static void sched_update_deadline(void)
+{
+    u64 deadline = g_sched.frame_end;
+    if(heap_len > 0)
+        deadline = MIN(deadline, event[heap[0]].when);
+    g_sched.deadline = deadline;
+}
+
+/**
+ * @brief  触发所有已到期的事件
+ * @retval 无
+ * @note 事件回调中可以再次调度事件，包括自身。
+ */
+static void sched_dispatch(void)
+{
+    while (heap_len > 0 && event[heap[0]].when <= g_sched.clock)
+    {
+        event_id id = heap[0];
+        heap_remove(0);
+        event[id].fire(event[id].when);
+    }
+}
+
+#pragma region "设备"
+/**
+ * @brief  向调度器注册需要追赶的设备
+ * @param  dev_name 设备名称
+ * @param  sync 追赶回调，参数为需要追赶到的主时钟周期
+ * @retval sched_id
+ * @note 返回 \c RET_ERR 说明注册失败。
+ */
+sched_id sched_register(char *dev_name, sync_fn sync)
+{
+    for (size_t i = 0; i < SCHED_DEV_MAX_NUM; i++)
+    {
+        if(dev[i].name != NULL)
+            continue;
+        dev[i].name = dev_name;
+        dev[i].sync = sync;
+        return i;
+    }
+    return RET_ERR;
+}
+
+/**
+ * @brief  卸载已注册的设备
+ * @param  id \c sched_register 返回的 sched_id
+ * @retval 无
+ * @note 非法的 sched_id 将无任何效果。
+ */
+void sched_remove(sched_id id)
+{
+    if(id < 0 || id >= SCHED_DEV_MAX_NUM)
+        return;
+    memset(dev + id, 0, sizeof(dev[0]));
+}
+
+/**
+ * @brief  将设备追赶到当前时刻
+ * @param  id 设备 sched_id
+ * @retval 无
+ * @note 设备寄存器被 CPU 访问时调用，保证设备状态与 CPU 一致。
+ */
+void sched_sync(sched_id id)
+{
+    LOG_ASSERT(id >= 0 && id < SCHED_DEV_MAX_NUM && dev[id].name != NULL);
+    dev[id].sync(g_sched.clock);
+}
+
+/**
+ * @brief  将设备追赶到当前时刻，但不越过本帧帧末
+ * @param  id 设备 sched_id
+ * @retval 无
+ * @note 帧循环以 CPU 指令为单位结束，时钟会越过帧末几个周期。帧之间调用的设置（如跳帧）
+ *       需要设备停在帧边界，越过的部分留到下一帧追赶。帧内与 \c sched_sync 相同。
+ */
+void sched_sync_frame(sched_id id)
+{
+    LOG_ASSERT(id >= 0 && id < SCHED_DEV_MAX_NUM && dev[id].name != NULL);
+    dev[id].sync(MIN(g_sched.clock, g_sched.frame_end));
+}
+#pragma endregion
+
+#pragma region "事件"
+/**
+ * @brief  注册定时事件
+ * @param  event_name 事件名称
+ * @param  fire 触发回调，参数为事件被调度的时刻
+ * @retval event_id
+ * @note 返回 \c RET_ERR 说明注册失败。注册后事件处于未排队状态。
+ */
+event_id sched_event_register(char *event_name, event_fn fire)
+{
+    for (size_t i = 0; i < SCHED_EVENT_MAX_NUM; i++)
+    {
+        if(event[i].name != NULL)
+            continue;
+        event[i].name = event_name;
+        event[i].fire = fire;
+        event[i].when = SCHED_NEVER;
+        event[i].slot = -1;
+        return i;
+    }
+    return RET_ERR;
+}
+
+/**
+ * @brief  注销定时事件
+ * @param  id \c sched_event_register 返回的 event_id
+ * @retval 无
+ * @note 非法的 event_id 将无任何效果。
+ */
+void sched_event_remove(event_id id)
+{
+    if(id < 0 || id >= SCHED_EVENT_MAX_NUM || event[id].name == NULL)
+        return;
+    sched_event_cancel(id);
+    memset(event + id, 0, sizeof(event[0]));
+}
+
+/**
+ * @brief  调度事件在指定时刻触发
+ * @param  id 事件 event_id
+ * @param  when 触发的主时钟周期
+ * @retval 无
+ * @note 事件必须处于未排队状态，已排队的事件请使用 \c sched_event_reschedule。
+ */
+void sched_event_schedule(event_id id, u64 when)
+{
+    LOG_ASSERT(id >= 0 && id < SCHED_EVENT_MAX_NUM && event[id].name != NULL);
+    LOG_ASSERT(event[id].slot < 0);
+    event[id].when = when;
+    heap[heap_len] = id;
+    heap_sift_up(heap_len++);
+    if(when < g_sched.deadline)
+        g_sched.deadline = when;
+}
+
+/**
+ * @brief  修改事件的触发时刻
+ * @param  id 事件 event_id
+ * @param  when 新的触发时刻
+ * @retval 无
+ * @note 未排队的事件将被调度。
+ */
+void sched_event_reschedule(event_id id, u64 when)
+{
+    LOG_ASSERT(id >= 0 && id < SCHED_EVENT_MAX_NUM && event[id].name != NULL);
+    if(event[id].slot < 0)
+    {
+        sched_event_schedule(id, when);
+        return;
+    }
+    u64 old = event[id].when;
+    event[id].when = when;
+    if(when < old)
+        heap_sift_up(event[id].slot);
+    else
+        heap_sift_down(event[id].slot);
+    if(when < g_sched.deadline)
+        g_sched.deadline = when;
+}
+
+/**
+ * @brief  取消事件
+ * @param  id 事件 event_id
+ * @retval 无
+ * @note 当前批次不会因取消而延长，下一批次开始时重新计算结束时刻。
+ */
+void sched_event_cancel(event_id id)
+{
+    LOG_ASSERT(id >= 0 && id < SCHED_EVENT_MAX_NUM && event[id].name != NULL);
+    if(event[id].slot < 0)
+        return;
+    heap_remove(event[id].slot);
+    event[id].when = SCHED_NEVER;
+}
+
+/**
+ * @brief  查询事件是否已排队
+ * @param  id 事件 event_id
+ * @retval 1: 已排队, 0: 未排队
+ */
+int sched_event_pending(event_id id)
+{
+    LOG_ASSERT(id >= 0 && id < SCHED_EVENT_MAX_NUM && event[id].name != NULL);
+    return event[id].slot >= 0;
+}
+
+/**
+ * @brief  查询事件的触发时刻
+ * @param  id 事件 event_id
+ * @retval 触发时刻，未排队时为 \c SCHED_NEVER
+ */
+u64 sched_event_time(event_id id)
+{
+    LOG_ASSERT(id >= 0 && id < SCHED_EVENT_MAX_NUM && event[id].name != NULL);
+    return event[id].when;
+}
+#pragma endregion
+
+/**
+ * @brief  复位主时钟
+ * @retval 无
+ * @note 已注册的设备与事件保持注册状态，所有事件被取消。
+ */
+void sched_reset(void)
+{
+    enum region region = g_sched.region;
+    memset(&g_sched, 0, sizeof(g_sched));
+    sched_set_region(region);
+    while (heap_len > 0)
+        sched_event_cancel(heap[0]);
+}
+
+/**
+ * @brief  切换制式
+ * @param  region 制式
+ * @retval 无
+ * @note 之后的帧使用该制式实例化的帧循环。
+ */
+void sched_set_region(enum region region)
+{
+    LOG_ASSERT(region >= 0 && region < REGION_NUM);
+    g_sched.region = region;
+    g_sched.timing = region_timings + region;
+}
+
+/**
+ * @brief  立即结束当前 CPU 批次
+ * @retval 无
+ * @note 用于中断等需要在下一条指令前处理的事件。
+ */
+void sched_break(void)
+{
+    g_sched.deadline = g_sched.clock;
+}
+
+/* 帧末只追赶到帧边界，见 sched_sync_frame */
+static void sched_sync_all(void)
+{
+    for (size_t i = 0; i < SCHED_DEV_MAX_NUM; i++)
+    {
+        if(dev[i].name != NULL)
+            dev[i].sync(MIN(g_sched.clock, g_sched.frame_end));
+    }
+}
+
+/* 每个制式实例化一份帧循环，CPU 批次与帧长度均为编译期常量 */
+#define SCHED_RUN_FRAME_DEFINE(ID, name, hz, cpu_div, ppu_div, lines, vblank_line, odd_skip, apu_quarter) \
+static void sched_run_frame_##name(void) \
+{ \
+    g_sched.frame_end += REGION_FRAME_CYCLES(ppu_div, lines); \
+    g_sched.batches = 0; \
+    while (g_sched.clock < g_sched.frame_end) \
+    { \
+        sched_update_deadline(); \
+        cpu_run_##name(); \
+        g_sched.batches++; \
+        sched_dispatch(); \
+    } \
+    sched_sync_all(); \
+}
+REGION_LIST(SCHED_RUN_FRAME_DEFINE)
+#undef SCHED_RUN_FRAME_DEFINE
+
+#define SCHED_RUN_FRAME_ENTRY(ID, name, ...) [REGION_##ID] = sched_run_frame_##name,
+static void (*const sched_run_frame_fn[REGION_NUM])(void) = {
+    REGION_LIST(SCHED_RUN_FRAME_ENTRY)
+};
+#undef SCHED_RUN_FRAME_ENTRY
+
+/**
+ * @brief  运行一帧
+ * @retval 无
+ * @note CPU 按批次运行到下一个事件，其他设备仅在被访问或到达同步点时追赶。
+ */
+void sched_run_frame(void)
+{
+    sched_run_frame_fn[g_sched.region]();
+}
@@ -0,0 +1,48 @@
+#include "core/nes/simd.h"
+
+static const char *simd_names[SIMD_LEVEL_NUM] = {
+    [SIMD_SCALAR] = "scalar",
+    [SIMD_SSE2] = "SSE2",
+    [SIMD_AVX2] = "AVX2",
+};
+
+/**
+ * @brief  判断当前 CPU 与编译器是否支持指定指令集
+ * @param  level 指令集
+ * @retval 1: 支持, 0: 不支持
+ */
+int simd_supported(enum simd_level level)
+{
+    if(level == SIMD_SCALAR)
+        return 1;
+#if SIMD_X86
+    __builtin_cpu_init();
+    if(level == SIMD_SSE2)
+        return __builtin_cpu_supports("sse2");
+    if(level == SIMD_AVX2)
+        return __builtin_cpu_supports("avx2");
+#endif
+    return 0;
+}
+
+/**
+ * @brief  查询当前 CPU 支持的最高指令集
+ * @retval 指令集
+ */
+enum simd_level simd_best(void)
+{
+    int level = SIMD_LEVEL_NUM - 1;
+    while (level > SIMD_SCALAR && !simd_supported(level))
+        level--;
+    return level;
+}
+
+/**
+ * @brief  指令集名称
+ * @param  level 指令集
+ * @retval 用于日志的名称
+ */
+const char *simd_name(enum simd_level level)
+{
+    return level >= 0 && level < SIMD_LEVEL_NUM ? simd_names[level] : "unknown";
+}
@@ -1,43 +1,523 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
+#include <string.h>
 
 #include "useful.h"
+#include "log.h"
 #include "libretro.h"
+#include "main.h"
+#include "core/nes/apu.h"
+#include "core/nes/cart.h"
+#include "core/nes/cpu.h"
+#include "core/nes/ntsc.h"
+#include "core/nes/palette.h"
+#include "core/nes/ppu.h"
+#include "core/nes/ram.h"
+#include "core/nes/resample.h"
+#include "core/nes/sched.h"
 
-#define WIDTH 640
-#define HEIGHT 480
-#define FPS 60.0
-#define SAMPLE_RATE 44100.0
-#define ASPECT_RATIO 4.0 / 3.0
-#define PITCH WIDTH * 4
+#define PIXEL_ASPECT (8.0 / 7.0)
+#define OVERSCAN_LINES 8
+#define FASTFORWARD_RENDER_INTERVAL 4
+#define FRAMESKIP_MAX 3              /* 最多连续跳过的帧数 */
+#define FRAMESKIP_LATENCY_FRAMES 6   /* 开启跳帧时向前端请求的音频延迟 */
+#define PALETTE_FILE "nes.pal"
 
 static struct retro_system_av_info g_av_info;
 static struct retro_framebuffer g_framebuffer;
+static retro_environment_t g_environ = NULL;
 static retro_video_refresh_t g_video_refresh = NULL;
-static uint32_t buf[WIDTH * HEIGHT] = {0};
+static retro_audio_sample_batch_t g_audio_batch = NULL;
+static s16 g_audio[APU_FRAME_SAMPLES * 2 * RESAMPLE_MAX_RATIO];
+static s16 g_audio_mono[APU_FRAME_SAMPLES];
+static struct resample g_resample;
+static u32 buf[2][NTSC_WIDTH * PPU_HEIGHT] = {0};
+static u8 g_buf_index = 0;
+static bool g_crop_overscan = false;
+static bool g_ntsc = false;
+static unsigned g_ntsc_frames = 0;
+static bool g_can_dupe = false;
+static bool g_audio_enable = true;
+static unsigned g_fastforward_frames = 0;
+
+enum frameskip_mode
+{
+    FRAMESKIP_DISABLED = 0,
+    FRAMESKIP_AUTO,         /* 前端预计欠载时跳帧 */
+    FRAMESKIP_THRESHOLD,    /* 音频缓冲占用低于阈值时跳帧 */
+};
+static enum frameskip_mode g_frameskip = FRAMESKIP_DISABLED;
+static unsigned g_frameskip_threshold = 0;
+static unsigned g_frameskip_frames = 0;
+static bool g_latency_pending = false;
+static bool g_audio_active = false;
+static unsigned g_audio_occupancy = 0;
+static bool g_audio_underrun = false;
+static bool g_persistent_data = false;  /* 前端保证 retro_game_info::data 在 retro_deinit 前有效 */
+static u8 *g_rom_copy = NULL;
+
+static struct retro_variable g_variables[] = {
+    { "nes_region", "Region; auto|NTSC|PAL|Dendy" },
+    { "nes_pixel_format", "Pixel format (restart); XRGB8888|RGB565" },
+    { "nes_crop_overscan", "Crop overscan; disabled|enabled" },
+    { "nes_ppu_thread", "Render on worker thread; disabled|enabled|validate" },
+    { "nes_sprite_limit", "Sprite limit; enabled|disabled" },
+    { "nes_ntsc_filter", "NTSC filter; disabled|enabled" },
+    { "nes_ntsc_threads", "NTSC filter threads; 1|2|4" },
+    { "nes_audio", "Audio synthesis; enabled|disabled" },
+    { "nes_frameskip", "Frameskip; disabled|auto|threshold" },
+    { "nes_frameskip_threshold", "Frameskip threshold (%); 33|25|40|50|60" },
+    { NULL, NULL },
+};
+
+/**
+ * @brief  读取制式选项
+ * @retval 选项对应的制式
+ * @note 选项为 auto 或前端不支持选项时使用卡带文件头中的制式，未加载卡带时使用 NTSC。
+ */
+static enum region retro_option_region(void)
+{
+    struct retro_variable var = { "nes_region", NULL };
+    if (g_environ && g_environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+    {
+        if (!strcmp(var.value, "NTSC"))
+            return REGION_NTSC;
+        if (!strcmp(var.value, "PAL"))
+            return REGION_PAL;
+        if (!strcmp(var.value, "Dendy"))
+            return REGION_DENDY;
+    }
+    return cart_info() ? cart_info()->region : REGION_NTSC;
+}
+
+/**
+ * @brief  读取裁剪过扫描区选项
+ * @retval 是否裁去上下各 8 行
+ */
+static bool retro_option_crop(void)
+{
+    struct retro_variable var = { "nes_crop_overscan", NULL };
+    if (!g_environ || !g_environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) || !var.value)
+        return false;
+    return !strcmp(var.value, "enabled");
+}
+
+/**
+ * @brief  读取 NTSC 滤镜选项
+ * @retval 是否开启
+ */
+static bool retro_option_ntsc(void)
+{
+    struct retro_variable var = { "nes_ntsc_filter", NULL };
+    if (!g_environ || !g_environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) || !var.value)
+        return false;
+    return !strcmp(var.value, "enabled");
+}
+
+/**
+ * @brief  读取 NTSC 滤镜线程数选项
+ * @retval 线程数，前端不支持选项时为 1
+ */
+static unsigned retro_option_ntsc_threads(void)
+{
+    struct retro_variable var = { "nes_ntsc_threads", NULL };
+    if (!g_environ || !g_environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) || !var.value)
+        return 1;
+    return strtoul(var.value, NULL, 10);
+}
+
+/**
+ * @brief  按选项设置 NTSC 滤镜的线程数
+ * @retval 无
+ */
+static void retro_update_ntsc_threads(void)
+{
+    unsigned num = retro_option_ntsc_threads();
+    if (ntsc_set_threads(num) != RET_OK)
+    {
+        LOG_L(LOG_WARN, "failed to start %u NTSC filter threads", num);
+        ntsc_set_threads(1);
+    }
+}
+
+/**
+ * @brief  读取每行精灵数限制选项
+ * @retval 是否限制每行 8 个精灵
+ * @note 关闭后可消除精灵闪烁，溢出标志仍正常模拟。
+ */
+static bool retro_option_sprite_limit(void)
+{
+    struct retro_variable var = { "nes_sprite_limit", NULL };
+    if (!g_environ || !g_environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) || !var.value)
+        return true;
+    return strcmp(var.value, "disabled") != 0;
+}
+
+/**
+ * @brief  读取 PPU 工作线程选项
+ * @retval 流水线模式
+ * @note 开启后画面比模拟晚一帧，validate 用于调试，每帧比较两条路径的结果。
+ */
+static enum ppu_pipeline_mode retro_option_pipeline(void)
+{
+    struct retro_variable var = { "nes_ppu_thread", NULL };
+    if (!g_environ || !g_environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) || !var.value)
+        return PPU_PIPELINE_OFF;
+    if (!strcmp(var.value, "enabled"))
+        return PPU_PIPELINE_ON;
+    if (!strcmp(var.value, "validate"))
+        return PPU_PIPELINE_VALIDATE;
+    return PPU_PIPELINE_OFF;
+}
+
+/**
+ * @brief  按选项开启或关闭 PPU 工作线程
+ * @retval 无
+ */
+static void retro_update_pipeline(void)
+{
+    if (ppu_pipeline(retro_option_pipeline()) != RET_OK)
+    {
+        LOG_L(LOG_WARN, "failed to start PPU thread");
+        ppu_pipeline(PPU_PIPELINE_OFF);
+    }
+}
+
+/**
+ * @brief  按裁剪选项更新输出尺寸
+ * @retval 无
+ * @note 输出 PPU 原生分辨率，像素宽高比 8:7，缩放交给前端。NTSC 滤镜输出两倍宽度，显示比例不变。
+ */
+static void retro_update_geometry(void)
+{
+    unsigned width = g_ntsc ? NTSC_WIDTH : PPU_WIDTH;
+    unsigned height = PPU_HEIGHT - (g_crop_overscan ? OVERSCAN_LINES * 2 : 0);
+    g_av_info.geometry.base_width = width;
+    g_av_info.geometry.base_height = height;
+    g_av_info.geometry.max_width = NTSC_WIDTH;
+    g_av_info.geometry.max_height = PPU_HEIGHT;
+    g_av_info.geometry.aspect_ratio = PPU_WIDTH * PIXEL_ASPECT / height;
+    g_framebuffer.width = width;
+    g_framebuffer.height = height;
+}
+
+/**
+ * @brief  获取本帧的输出画面
+ * @param  surface 输出画面
+ * @param  pipelined 是否开启了 PPU 工作线程
+ * @retval 无
+ * @note 优先使用前端提供的软件帧缓冲，颜色下标直接转换到其中，省去一次复制；
+ *       前端不提供或格式、尺寸不符时使用内部缓冲。
+ *       开启工作线程时画面在下一帧才提交，前端帧缓冲届时可能已失效，因此轮流使用两块内部缓冲。
+ */
+static void retro_get_surface(struct ppu_surface *surface, bool pipelined)
+{
+    struct retro_framebuffer fb = {
+        .width = g_framebuffer.width,
+        .height = g_framebuffer.height,
+        .access_flags = RETRO_MEMORY_ACCESS_WRITE,
+    };
+
+    surface->bytes = palette_format() == PALETTE_RGB565 ? sizeof(u16) : sizeof(u32);
+    surface->top = g_crop_overscan ? OVERSCAN_LINES : 0;
+    surface->height = g_framebuffer.height;
+    if (pipelined)
+    {
+        g_buf_index ^= 1;
+        surface->data = buf[g_buf_index];
+        surface->pitch = g_framebuffer.width * surface->bytes;
+        return;
+    }
+    if (g_environ && g_environ(RETRO_ENVIRONMENT_GET_CURRENT_SOFTWARE_FRAMEBUFFER, &fb)
+        && fb.data && fb.format == g_framebuffer.format
+        && fb.width >= g_framebuffer.width && fb.height >= g_framebuffer.height)
+    {
+        surface->data = fb.data;
+        surface->pitch = fb.pitch;
+        return;
+    }
+    surface->data = buf[0];
+    surface->pitch = g_framebuffer.width * surface->bytes;
+}
+
+/**
+ * @brief  读取音频合成选项
+ * @retval 是否合成音频
+ * @note 关闭后 APU 只模拟计数器与中断等可观测状态，用于无需声音的批量运行。
+ */
+static bool retro_option_audio(void)
+{
+    struct retro_variable var = { "nes_audio", NULL };
+    if (!g_environ || !g_environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) || !var.value)
+        return true;
+    return strcmp(var.value, "disabled") != 0;
+}
+
+/**
+ * @brief  查询前端本帧是否需要音视频
+ * @retval \c RETRO_AV_ENABLE_VIDEO 与 \c RETRO_AV_ENABLE_AUDIO 的组合
+ * @note 前端不支持查询时两者都需要。
+ */
+static int retro_av_enable(void)
+{
+    int av_enable = RETRO_AV_ENABLE_VIDEO | RETRO_AV_ENABLE_AUDIO;
+    if (!g_environ || !g_environ(RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE, &av_enable))
+        return RETRO_AV_ENABLE_VIDEO | RETRO_AV_ENABLE_AUDIO;
+    return av_enable;
+}
+
+/**
+ * @brief  前端通知音频缓冲占用
+ * @param  active 前端音频是否开启
+ * @param  occupancy 占用百分比
+ * @param  underrun_likely 下一帧是否可能欠载
+ * @retval 无
+ * @note 每帧 \c retro_run 之前调用。
+ */
+static void RETRO_CALLCONV retro_audio_buffer_status(bool active, unsigned occupancy, bool underrun_likely)
+{
+    g_audio_active = active;
+    g_audio_occupancy = occupancy;
+    g_audio_underrun = underrun_likely;
+}
+
+/**
+ * @brief  按选项设置跳帧策略
+ * @retval 无
+ * @note 前端不支持音频缓冲占用回调或重复帧时不跳帧。音频延迟在下一次 \c retro_run 中请求。
+ */
+static void retro_update_frameskip(void)
+{
+    struct retro_variable var = { "nes_frameskip", NULL };
+    struct retro_variable threshold = { "nes_frameskip_threshold", NULL };
+    struct retro_audio_buffer_status_callback status = { retro_audio_buffer_status };
+    enum frameskip_mode mode = FRAMESKIP_DISABLED;
+
+    if (!g_environ)
+        return;
+    if (g_environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+    {
+        if (!strcmp(var.value, "auto"))
+            mode = FRAMESKIP_AUTO;
+        else if (!strcmp(var.value, "threshold"))
+            mode = FRAMESKIP_THRESHOLD;
+    }
+    g_frameskip_threshold = 33;
+    if (g_environ(RETRO_ENVIRONMENT_GET_VARIABLE, &threshold) && threshold.value)
+        g_frameskip_threshold = strtoul(threshold.value, NULL, 10);
+    if (mode == g_frameskip)
+        return;
+
+    if (mode != FRAMESKIP_DISABLED
+        && (!g_can_dupe || !g_environ(RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK, &status)))
+    {
+        LOG_L(LOG_WARN, "frameskip unavailable");
+        mode = FRAMESKIP_DISABLED;
+    }
+    if (mode == FRAMESKIP_DISABLED)
+        g_environ(RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK, NULL);
+    g_frameskip = mode;
+    g_frameskip_frames = 0;
+    g_audio_active = false;
+    g_latency_pending = true;
+}
+
+/**
+ * @brief  按跳帧策略请求前端音频延迟
+ * @retval 无
+ * @note 只能在 \c retro_run 中调用。开启跳帧时请求若干帧的延迟，给跳帧留出余量。
+ */
+static void retro_update_latency(void)
+{
+    unsigned latency = 0;
+    if (g_frameskip != FRAMESKIP_DISABLED)
+        latency = (unsigned)(FRAMESKIP_LATENCY_FRAMES * 1000.0 / g_sched.timing->fps + 0.5);
+    g_environ(RETRO_ENVIRONMENT_SET_MINIMUM_AUDIO_LATENCY, &latency);
+    g_latency_pending = false;
+}
+
+/**
+ * @brief  根据音频缓冲占用判断是否跳过本帧画面
+ * @retval 是否跳过
+ * @note 主机负载过高时以少画几帧代替音频欠载，连续跳过的帧数有上限。
+ */
+static bool retro_frameskip(void)
+{
+    bool skip = false;
+    if (!g_audio_active)
+        return false;
+    if (g_frameskip == FRAMESKIP_AUTO)
+        skip = g_audio_underrun;
+    else if (g_frameskip == FRAMESKIP_THRESHOLD)
+        skip = g_audio_occupancy < g_frameskip_threshold;
+    if (!skip || g_frameskip_frames >= FRAMESKIP_MAX)
+    {
+        g_frameskip_frames = 0;
+        return false;
+    }
+    g_frameskip_frames++;
+    return true;
+}
+
+/**
+ * @brief  判断本帧是否需要输出画面
+ * @param  av_enable \c retro_av_enable 的结果
+ * @retval 是否需要渲染
+ * @note 前端关闭视频（run-ahead、联机追帧等）或音频缓冲不足需要跳帧时不渲染；
+ *       快进时每隔若干帧渲染一帧，其余帧以重复帧提交，前端不支持重复帧时照常渲染。
+ */
+static bool retro_video_wanted(int av_enable)
+{
+    bool fastforward = false;
+
+    if (!g_environ)
+        return true;
+    if (!(av_enable & RETRO_AV_ENABLE_VIDEO))
+        return false;
+    if (retro_frameskip())
+        return false;
+    if (!g_can_dupe || !g_environ(RETRO_ENVIRONMENT_GET_FASTFORWARDING, &fastforward) || !fastforward)
+    {
+        g_fastforward_frames = 0;
+        return true;
+    }
+    return g_fastforward_frames++ % FASTFORWARD_RENDER_INTERVAL == 0;
+}
+
+/**
+ * @brief  与前端协商输出像素格式
+ * @retval 无
+ * @note 优先使用选项指定的格式，前端不接受时回退到 XRGB8888。
+ *       libretro 要求在 retro_load_game 中设置，retro_init 只使用内部默认值。
+ */
+static void retro_negotiate_format(void)
+{
+    struct retro_variable var = { "nes_pixel_format", NULL };
+    enum retro_pixel_format fmt = RETRO_PIXEL_FORMAT_RGB565;
+
+    palette_set_format(PALETTE_XRGB8888);
+    g_framebuffer.format = RETRO_PIXEL_FORMAT_XRGB8888;
+    if(!g_environ)
+        return;
+    if(g_environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value && !strcmp(var.value, "RGB565")
+        && g_environ(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt))
+    {
+        palette_set_format(PALETTE_RGB565);
+        g_framebuffer.format = RETRO_PIXEL_FORMAT_RGB565;
+        return;
+    }
+    fmt = RETRO_PIXEL_FORMAT_XRGB8888;
+    g_environ(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt);
+}
+
+/**
+ * @brief  从系统目录加载调色板文件
+ * @retval 无
+ * @note 文件不存在时使用默认调色板。
+ */
+static void retro_load_palette(void)
+{
+    const char *dir = NULL;
+    char path[1024];
+
+    palette_init();
+    if(!g_environ || !g_environ(RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY, &dir) || !dir)
+        return;
+    snprintf(path, sizeof(path), "%s/%s", dir, PALETTE_FILE);
+    if(palette_load(path) == RET_OK)
+        LOG("palette: %s", path);
+}
+
+/**
+ * @brief  按前端目标采样率设置合成采样率
+ * @retval 无
+ * @note 合成直接在目标采样率下进行，前端无需重采样。目标高于合成缓冲支持的采样率时，
+ *       以其整数分之一合成，再多相插值升采样。前端不支持查询时使用默认采样率。
+ */
+static void retro_update_sample_rate(void)
+{
+    unsigned target = 0, ratio = 1;
+    if (!g_environ || !g_environ(RETRO_ENVIRONMENT_GET_TARGET_SAMPLE_RATE, &target) || target == 0)
+        target = APU_SAMPLE_RATE;
+    while (target > (double)BLIP_MAX_RATE * ratio && ratio < RESAMPLE_MAX_RATIO)
+        ratio++;
+    apu_set_sample_rate(MIN((double)target / ratio, BLIP_MAX_RATE));
+    resample_init(&g_resample, ratio);
+    LOG("audio: %u Hz, synthesised at %.0f Hz", target, apu_sample_rate());
+}
+
+/**
+ * @brief  按当前制式更新时序信息
+ * @retval 无
+ */
+static void retro_update_timing(void)
+{
+    g_av_info.timing.fps = g_sched.timing->fps;
+    g_av_info.timing.sample_rate = apu_sample_rate() * g_resample.ratio;
+}
+
+/**
+ * @brief  输出本帧的音频
+ * @retval 无
+ * @note 一帧的立体声采样攒在内部缓冲中，一次批量提交。前端未设置回调时丢弃采样。
+ */
+static void retro_output_audio(void)
+{
+    size_t frames, done = 0;
+    apu_end_frame();
+    if (g_resample.ratio > 1)
+    {
+        frames = apu_read_samples(g_audio_mono, APU_FRAME_SAMPLES, 0);
+        frames = resample_run(&g_resample, g_audio, g_audio_mono, frames);
+    }
+    else
+    {
+        frames = apu_read_samples(g_audio, APU_FRAME_SAMPLES, 1);
+    }
+    while (g_audio_batch && done < frames)
+    {
+        size_t n = g_audio_batch(g_audio + done * 2, frames - done);
+        if (n == 0)
+            break;
+        done += n;
+    }
+}
 
 void retro_init(void)
 {
-    srand((unsigned int)time(NULL));
-    g_av_info.geometry.base_width = WIDTH;
-    g_av_info.geometry.base_height = HEIGHT;
-    g_av_info.geometry.max_width = WIDTH;
-    g_av_info.geometry.max_height = HEIGHT;
-    g_av_info.geometry.aspect_ratio = ASPECT_RATIO;
-    g_av_info.timing.fps = FPS;
-    g_av_info.timing.sample_rate = SAMPLE_RATE;
-
-    g_framebuffer.width = WIDTH;
-    g_framebuffer.height = HEIGHT;
-    g_framebuffer.pitch = WIDTH * 4;
+    g_crop_overscan = retro_option_crop();
+    g_ntsc = retro_option_ntsc();
+    retro_update_geometry();
+    palette_set_format(PALETTE_XRGB8888);
     g_framebuffer.format = RETRO_PIXEL_FORMAT_XRGB8888;
-    g_framebuffer.data = buf;
+    retro_load_palette();
+    if (!g_environ || !g_environ(RETRO_ENVIRONMENT_GET_CAN_DUPE, &g_can_dupe))
+        g_can_dupe = false;
+
+    ram_init();
+    cpu_init();
+    sched_set_region(retro_option_region());
+    sched_reset();
+    ppu_init();
+    apu_init();
+    retro_update_sample_rate();
+    g_audio_enable = retro_option_audio();
+    ppu_set_sprite_limit(retro_option_sprite_limit());
+    retro_update_pipeline();
+    ntsc_init();
+    retro_update_ntsc_threads();
+    retro_update_timing();
+    retro_update_frameskip();
     return;
 }
 
 void retro_deinit(void)
 {
+    retro_unload_game();
+    ppu_pipeline(PPU_PIPELINE_OFF);
+    ntsc_set_threads(1);
+    g_frameskip = FRAMESKIP_DISABLED;
+    g_audio_active = false;
     return;
 }
 
@@ -48,25 +528,171 @@ void retro_get_system_av_info(struct retro_system_av_info *info)
 
 void retro_run(void)
 {
+    int av_enable;
+    bool updated = false;
+    struct ppu_surface surface;
+    const struct ppu_surface *frame;
     if (!g_video_refresh) return;
-    for (size_t i = 0; i < ARRARY_LEN(buf); i++)
+    if (g_environ && g_environ(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &updated) && updated)
     {
-        uint8_t r = rand(); // 0–255
-        uint8_t g = rand(); // 0–255
-        uint8_t b = rand();
-        buf[i] = 0xFF << 24 | r << 16 | g << 8 | b;
+        if (retro_option_region() != g_sched.region)
+        {
+            sched_set_region(retro_option_region());
+            retro_reset();
+            retro_update_timing();
+            g_environ(RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO, &g_av_info);
+            g_latency_pending = true;
+        }
+        if (retro_option_crop() != g_crop_overscan || retro_option_ntsc() != g_ntsc)
+        {
+            g_crop_overscan = retro_option_crop();
+            g_ntsc = retro_option_ntsc();
+            retro_update_geometry();
+            ppu_invalidate();
+            g_environ(RETRO_ENVIRONMENT_SET_GEOMETRY, &g_av_info.geometry);
+        }
+        if (retro_option_pipeline() != ppu_pipeline_mode())
+            retro_update_pipeline();
+        ppu_set_sprite_limit(retro_option_sprite_limit());
+        if (retro_option_ntsc_threads() != ntsc_threads())
+            retro_update_ntsc_threads();
+        retro_update_frameskip();
+        g_audio_enable = retro_option_audio();
     }
+    if (g_latency_pending)
+        retro_update_latency();
+    av_enable = retro_av_enable();
+    apu_set_audio(g_audio_enable && (av_enable & RETRO_AV_ENABLE_AUDIO));
+    ppu_set_skip(!retro_video_wanted(av_enable));
+    /* NTSC 滤镜在呈现时才从颜色下标生成画面，PPU 使用内部缓冲 */
+    retro_get_surface(&surface, !g_ntsc && ppu_pipeline_mode() != PPU_PIPELINE_OFF);
+    ppu_set_surface(g_ntsc ? NULL : &surface);
+    sched_run_frame();
+    ppu_pipeline_submit();
+    retro_output_audio();
 
-    g_video_refresh(buf, WIDTH, HEIGHT, PITCH);
+    /* 画面与上一帧相同或本帧被跳过时让前端重复上一帧，省去转换、上传与呈现；
+       开启工作线程后的第一帧及改变裁剪前渲染的帧与当前输出设置不符，同样跳过 */
+    if (ppu_frame_skipped() || (g_can_dupe && !ppu_frame_dirty()))
+    {
+        g_video_refresh(NULL, g_framebuffer.width, g_framebuffer.height, surface.pitch);
+        return;
+    }
+    if (g_ntsc)
+    {
+        ntsc_filter(surface.data, surface.pitch, surface.bytes, ppu_frame_index(),
+                    surface.top, surface.height, g_ntsc_frames++);
+        g_framebuffer.data = surface.data;
+        g_framebuffer.pitch = surface.pitch;
+        g_video_refresh(surface.data, g_framebuffer.width, g_framebuffer.height, surface.pitch);
+        return;
+    }
+    frame = ppu_frame_surface();
+    if (frame->bytes != surface.bytes || frame->top != surface.top || frame->height != surface.height)
+    {
+        g_video_refresh(NULL, g_framebuffer.width, g_framebuffer.height, surface.pitch);
+        return;
+    }
+    g_framebuffer.data = frame->data;
+    g_framebuffer.pitch = frame->pitch;
+    g_video_refresh(frame->data, g_framebuffer.width, g_framebuffer.height, frame->pitch);
     return;
 }
 
+unsigned retro_get_region(void)
+{
+    return g_sched.region == REGION_NTSC ? RETRO_REGION_NTSC : RETRO_REGION_PAL;
+}
+
 void retro_reset(void)
 {
+    cpu_init();
+    sched_reset();
+    ppu_reset();
+    apu_reset();
+    cart_reset();
+    cpu_reset();
     return;
 }
 
+void retro_get_system_info(struct retro_system_info *info)
+{
+    memset(info, 0, sizeof(*info));
+    info->library_name = "nes";
+    info->library_version = VERSION;
+    info->valid_extensions = "nes";
+    info->need_fullpath = false;
+}
+
+/* 镜像直接映射 PRG 与 CHR：前端保证数据持续有效时使用其缓冲，否则映射文件，
+   两者都不可用时才复制一份 */
+bool retro_load_game(const struct retro_game_info *game)
+{
+    int ret = RET_ERR;
+    if (!game)
+        return false;
+    retro_unload_game();
+    if (game->data && (g_persistent_data || !game->path))
+    {
+        if (!g_persistent_data)
+        {
+            g_rom_copy = malloc(game->size);
+            if (!g_rom_copy)
+                return false;
+            memcpy(g_rom_copy, game->data, game->size);
+        }
+        ret = cart_load(g_rom_copy ? g_rom_copy : game->data, game->size);
+    }
+    else if (game->path)
+    {
+        ret = cart_load_file(game->path);
+    }
+    if (ret != RET_OK)
+    {
+        retro_unload_game();
+        return false;
+    }
+    retro_negotiate_format();
+    /* 前端在加载之后才读取 AV 信息，此时切换制式无需通知 */
+    if (retro_option_region() != g_sched.region)
+    {
+        sched_set_region(retro_option_region());
+        retro_update_timing();
+    }
+    retro_reset();
+    return true;
+}
+
+void retro_unload_game(void)
+{
+    cart_unload();
+    free(g_rom_copy);
+    g_rom_copy = NULL;
+}
+
+void retro_set_environment(retro_environment_t cb)
+{
+    static const struct retro_system_content_info_override content[] = {
+        { "nes", false, true },
+        { NULL, false, false },
+    };
+    g_environ = cb;
+    g_environ(RETRO_ENVIRONMENT_SET_VARIABLES, g_variables);
+    g_persistent_data = g_environ(RETRO_ENVIRONMENT_SET_CONTENT_INFO_OVERRIDE, (void *)content);
+}
+
 void retro_set_video_refresh(retro_video_refresh_t cb)
 {
     g_video_refresh = cb;
 }
+
+void retro_set_audio_sample(retro_audio_sample_t cb)
+{
+    /* 音频只通过批量接口提交 */
+    UNUSED(cb);
+}
+
+void retro_set_audio_sample_batch(retro_audio_sample_batch_t cb)
+{
+    g_audio_batch = cb;
+}
@@ -0,0 +1,325 @@
+#define LOG_IMPLEMENTATION
+#include "log.h"
+#include "apu_test.h"
+
+/* 方波频率与每帧采样数 */
+static void test_pulse(void)
+{
+    const u16 timer = 253;
+    unsigned total;
+
+    setup();
+    bus_write(0x4017, 0x40);
+    bus_write(0x4015, 0x01);
+    bus_write(0x4000, 0xBF);
+    bus_write(0x4002, timer & 0xFF);
+    bus_write(0x4003, timer >> 8);
+    run_frame();
+    double freq = measure_hz(60, &total);
+    double expect = CPU_HZ / (16.0 * (timer + 1));
+    LOG("pulse: %u samples, %.1f Hz (expect %.1f Hz)", total, freq, expect);
+    LOG_ASSERT(total > 60 * APU_SAMPLE_RATE / g_sched.timing->fps - 2);
+    LOG_ASSERT(total < 60 * APU_SAMPLE_RATE / g_sched.timing->fps + 2);
+    LOG_ASSERT(freq > expect - 2 && freq < expect + 2);
+}
+
+/* 扫频只看静音条件：音量为 0 时周期照常更新 */
+static void test_sweep_silent(void)
+{
+    const u16 timer = 0x300;
+    unsigned total;
+
+    setup();
+    bus_write(0x4017, 0x40);
+    bus_write(0x4015, 0x01);
+    bus_write(0x4000, 0x30);    /* 固定音量 0 */
+    bus_write(0x4001, 0x8F);    /* 每个半帧减少 timer >> 7 */
+    bus_write(0x4002, timer & 0xFF);
+    bus_write(0x4003, timer >> 8);
+    for (int frame = 0; frame < 10; frame++)
+        run_frame();
+    bus_write(0x4001, 0x00);
+    bus_write(0x4000, 0xBF);
+    run_frame();
+    double freq = measure_hz(30, &total);
+    double still = CPU_HZ / (16.0 * (timer + 1));
+    LOG("sweep while silent: %.1f Hz (unswept %.1f Hz)", freq, still);
+    LOG_ASSERT(freq > still + 10);
+}
+
+/* 长度计数器在半帧时钟递减，$4015 反映计数器状态 */
+static void test_length(void)
+{
+    setup();
+    bus_write(0x4017, 0x40);
+    bus_write(0x4015, 0x0F);
+    bus_write(0x4000, 0x1F);
+    bus_write(0x4002, 0x80);
+    bus_write(0x4003, 0x00);    /* 长度 10，即 5 个完整的 4 步序列 */
+    LOG_ASSERT(bus_read(0x4015) & 0x01);
+    for (int frame = 0; frame < 4; frame++)
+        run_frame();
+    LOG_ASSERT(bus_read(0x4015) & 0x01);
+    for (int frame = 0; frame < 2; frame++)
+        run_frame();
+    LOG_ASSERT(!(bus_read(0x4015) & 0x01));
+
+    /* 关闭声道立即清零计数器，关闭时写入的长度被忽略 */
+    bus_write(0x4003, 0x08);
+    LOG_ASSERT(bus_read(0x4015) & 0x01);
+    bus_write(0x4015, 0x00);
+    bus_write(0x4003, 0x08);
+    LOG_ASSERT(!(bus_read(0x4015) & 0x0F));
+}
+
+/* 4 步模式在序列末尾产生帧中断，读取 $4015 清除 */
+static void test_frame_irq(void)
+{
+    setup();
+    bus_write(0x4017, 0x00);
+    run_frame();
+    /* NTSC 一帧约 29781 个 CPU 周期，中断在第 29829 个周期 */
+    LOG_ASSERT(!(bus_read(0x4015) & 0x40));
+    run_frame();
+    LOG_ASSERT(bus_read(0x4015) & 0x40);
+    LOG_ASSERT(!(bus_read(0x4015) & 0x40));
+
+    bus_write(0x4017, 0x80);
+    for (int frame = 0; frame < 3; frame++)
+        run_frame();
+    LOG_ASSERT(!(bus_read(0x4015) & 0x40));
+}
+
+/* SEI 屏蔽帧中断：中断挂起时 CPU 照常循环，与关闭帧中断时执行的指令相同 */
+static u8 masked_run(u8 frame)
+{
+    setup();
+    bus_write(0x4017, frame);
+    for (int i = 0; i < 3; i++)
+        run_frame();
+    return bus_read(0x4F01);
+}
+
+static void test_irq_masked(void)
+{
+    u8 inhibit = masked_run(0x40);
+    u8 pending = masked_run(0x00);
+    LOG_ASSERT(bus_read(0x4015) & 0x40);
+    LOG_ASSERT(bus_read(0x4F03) & 0x04);
+    LOG_ASSERT(pending == inhibit);
+}
+
+/* DMC 读完最后一个字节时产生中断 */
+static u8 dmc_status;
+static void dmc_poll(u64 when)
+{
+    UNUSED(when);
+    dmc_status = bus_read(0x4015);
+}
+
+static void test_dmc_irq(void)
+{
+    static char name[] = "dmc poll";
+    setup();
+    bus_write(0x4017, 0x40);
+    bus_write(0x4010, 0x8F);    /* 中断，周期 54 */
+    bus_write(0x4012, 0x00);
+    bus_write(0x4013, 0x01);    /* 17 字节 */
+    bus_write(0x4015, 0x10);
+    LOG_ASSERT(bus_read(0x4015) & 0x10);
+
+    /* 第一个字节立即读取，其余每 8 * 54 个周期读取一个 */
+    u64 start = g_sched.clock;
+    event_id poll = sched_event_register(name, dmc_poll);
+    sched_event_schedule(poll, start + 16 * 8 * 54 * g_sched.timing->cpu_div - 600 * g_sched.timing->cpu_div);
+    run_frame();
+    LOG_ASSERT(dmc_status & 0x10);
+    LOG_ASSERT(!(dmc_status & 0x80));
+    u8 status = bus_read(0x4015);
+    LOG_ASSERT(!(status & 0x10));
+    LOG_ASSERT(status & 0x80);
+    bus_write(0x4015, 0x00);
+    LOG_ASSERT(!(bus_read(0x4015) & 0x80));
+    sched_event_remove(poll);
+}
+
+/* DMC 每次读取占用 CPU 4 个周期：同样时长内执行的 INX 变少 */
+static u8 stall_x;
+static void stall_poll(u64 when)
+{
+    UNUSED(when);
+    stall_x = bus_read(0x4F01);
+}
+
+static u8 stall_run(int dmc)
+{
+    static char name[] = "stall poll";
+    setup();
+    bus_write(0x4017, 0x40);
+    bus_write(0x4010, 0x4F);    /* 循环，周期 54 */
+    bus_write(0x4013, 0x00);
+    bus_write(0x4015, dmc ? 0x10 : 0x00);
+    event_id poll = sched_event_register(name, stall_poll);
+    /* 1200 个周期内读取 3 次，INX 与 JMP 每轮 5 个周期，X 不会回绕 */
+    sched_event_schedule(poll, g_sched.clock + 1200 * g_sched.timing->cpu_div);
+    run_frame();
+    sched_event_remove(poll);
+    return stall_x;
+}
+
+static void test_dmc_stall(void)
+{
+    u8 idle = stall_run(0);
+    u8 busy = stall_run(1);
+    LOG("dmc stall: %u iterations idle, %u with DMC", idle, busy);
+    LOG_ASSERT(idle - busy >= 2 && idle - busy <= 3);
+}
+
+/* 关闭音频时不输出采样，长度计数器、DMC 与中断照常 */
+static void test_audio_off(void)
+{
+    setup();
+    apu_set_audio(0);
+    bus_write(0x4017, 0x00);
+    bus_write(0x4015, 0x11);
+    bus_write(0x4000, 0x1F);
+    bus_write(0x4003, 0x00);
+    bus_write(0x4010, 0x8F);
+    bus_write(0x4013, 0x01);
+    bus_write(0x4015, 0x11);
+    for (int frame = 0; frame < 4; frame++)
+        LOG_ASSERT(run_frame() == 0);
+    u8 status = bus_read(0x4015);
+    LOG_ASSERT(status == 0xC1);
+    for (int frame = 0; frame < 2; frame++)
+        run_frame();
+    LOG_ASSERT(!(bus_read(0x4015) & 0x01));
+
+    /* 重新开启后从当前状态继续合成 */
+    apu_set_audio(1);
+    bus_write(0x4000, 0xBF);
+    bus_write(0x4002, 0x80);
+    bus_write(0x4003, 0x08);
+    unsigned n = run_frame();
+    s16 peak = 0;
+    LOG_ASSERT(n > 0);
+    for (unsigned i = 0; i < n; i++)
+        peak = MAX(peak, samples[i]);
+    LOG_ASSERT(peak > 1000);
+}
+
+/* 开关音频不打断波形：两帧之间关闭又开启，输出与一直开启逐采样相同 */
+static void test_audio_toggle(void)
+{
+    static s16 expect[3][APU_FRAME_SAMPLES];
+    unsigned count[3];
+    for (int pass = 0; pass < 2; pass++)
+    {
+        setup();
+        bus_write(0x4017, 0x40);
+        bus_write(0x4015, 0x05);
+        bus_write(0x4000, 0xBF);
+        bus_write(0x4002, 0x3F);
+        bus_write(0x4003, 0x08);
+        bus_write(0x4008, 0xFF);
+        bus_write(0x400A, 0x55);
+        bus_write(0x400B, 0x08);
+        for (int frame = 0; frame < 3; frame++)
+        {
+            if(pass == 1)
+            {
+                apu_set_audio(0);
+                apu_set_audio(1);
+            }
+            unsigned n = run_frame();
+            if(pass == 0)
+            {
+                count[frame] = n;
+                memcpy(expect[frame], samples, n * sizeof(s16));
+                continue;
+            }
+            LOG_ASSERT(n == count[frame]);
+            LOG_ASSERT(memcmp(expect[frame], samples, n * sizeof(s16)) == 0);
+        }
+    }
+}
+
+/* 分声道采集：只有方波 1 时与主输出逐采样相同，其他声道为 0 */
+static void test_capture(void)
+{
+    static s16 capture[APU_CAPTURE_NUM][APU_FRAME_SAMPLES];
+    setup();
+    apu_set_capture(1);
+    bus_write(0x4017, 0x40);
+    bus_write(0x4015, 0x05);
+    bus_write(0x4000, 0xBF);
+    bus_write(0x4002, 0x80);
+    bus_write(0x4003, 0x08);
+    for (int frame = 0; frame < 3; frame++)
+    {
+        unsigned n = run_frame();
+        for (unsigned ch = 0; ch < APU_CAPTURE_NUM; ch++)
+            LOG_ASSERT(apu_read_capture(ch, capture[ch], APU_FRAME_SAMPLES) == n);
+        for (unsigned i = 0; i < n; i++)
+        {
+            LOG_ASSERT(capture[APU_PULSE1][i] == samples[i]);
+            for (unsigned ch = APU_PULSE2; ch < APU_CAPTURE_NUM; ch++)
+                LOG_ASSERT(capture[ch][i] == 0);
+        }
+    }
+
+    /* 加入三角波后只出现在自己的缓冲中 */
+    bus_write(0x4008, 0xFF);
+    bus_write(0x400A, 0x80);
+    bus_write(0x400B, 0x08);
+    unsigned n = run_frame();
+    s16 peak = 0;
+    LOG_ASSERT(apu_read_capture(APU_TRIANGLE, capture[APU_TRIANGLE], n) == n);
+    LOG_ASSERT(apu_read_capture(APU_NOISE, capture[APU_NOISE], n) == n);
+    for (unsigned i = 0; i < n; i++)
+    {
+        peak = MAX(peak, capture[APU_TRIANGLE][i]);
+        LOG_ASSERT(capture[APU_NOISE][i] == 0);
+    }
+    LOG_ASSERT(peak > 1000);
+
+    apu_set_capture(0);
+    run_frame();
+    LOG_ASSERT(apu_read_capture(APU_PULSE1, capture[APU_PULSE1], APU_FRAME_SAMPLES) == 0);
+}
+
+/* 静音时输出为 0，直流阶跃被高通滤除 */
+static void test_silence(void)
+{
+    setup();
+    bus_write(0x4017, 0x40);
+    unsigned n = run_frame();
+    for (unsigned i = 0; i < n; i++)
+        LOG_ASSERT(samples[i] == 0);
+
+    bus_write(0x4011, 0x7F);
+    n = run_frame();
+    s16 peak = 0;
+    for (unsigned i = 0; i < n; i++)
+        peak = MAX(peak, samples[i]);
+    LOG_ASSERT(peak > 8000);
+    for (int frame = 0; frame < 60; frame++)
+        n = run_frame();
+    LOG_ASSERT(samples[n - 1] < peak / 8);
+}
+
+int main()
+{
+    test_pulse();
+    test_sweep_silent();
+    test_length();
+    test_frame_irq();
+    test_irq_masked();
+    test_dmc_irq();
+    test_dmc_stall();
+    test_audio_off();
+    test_audio_toggle();
+    test_capture();
+    test_silence();
+    return 0;
+}
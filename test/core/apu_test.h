@@ -0,0 +1,59 @@
+#pragma once
+#include "log.h"
+#include "core/nes/apu.h"
+#include "core/nes/bus.h"
+#include "core/nes/cpu.h"
+#include "core/nes/ram.h"
+#include "core/nes/sched.h"
+
+/* APU 与扩展音源测试共用：RAM 中循环执行的程序、逐帧读出采样与按过零次数测频 */
+
+#define CPU_HZ ((double)g_sched.timing->master_hz / g_sched.timing->cpu_div)
+
+u8 rom[] = {
+    0x78,               // SEI
+    0xe8,               // INX
+    0x4c, 0x01, 0x00    // JMP $0001
+};
+
+static s16 samples[APU_FRAME_SAMPLES];
+
+static void setup(void)
+{
+    cpu_init();
+    ram_init();
+    for (size_t i = 0; i < sizeof(rom); i++)
+        bus_write(i, rom[i]);
+    sched_reset();
+    LOG_ASSERT(apu_init() != RET_ERR);
+}
+
+/* 运行一帧并读出全部采样，返回采样数 */
+static unsigned run_frame(void)
+{
+    sched_run_frame();
+    apu_end_frame();
+    unsigned n = apu_samples_avail();
+    LOG_ASSERT(n <= APU_FRAME_SAMPLES);
+    LOG_ASSERT(apu_read_samples(samples, n, 0) == n);
+    return n;
+}
+
+/* 运行若干帧，按过零次数测量输出频率，total 返回采样总数 */
+static double measure_hz(int frames, unsigned *total)
+{
+    unsigned crossings = 0;
+    s16 last = 0;
+    *total = 0;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        unsigned n = run_frame();
+        for (unsigned i = 0; i < n; i++)
+        {
+            crossings += (samples[i] >= 0) != (last >= 0);
+            last = samples[i];
+        }
+        *total += n;
+    }
+    return crossings / 2.0 / (*total / (double)APU_SAMPLE_RATE);
+}
@@ -0,0 +1,211 @@
+#define LOG_IMPLEMENTATION
+#include <stdio.h>
+#include <unistd.h>
+#include "log.h"
+#include "core/nes/apu.h"
+#include "core/nes/bus.h"
+#include "core/nes/cart.h"
+#include "core/nes/chr.h"
+#include "core/nes/cpu.h"
+#include "core/nes/ppu.h"
+#include "core/nes/ram.h"
+#include "core/nes/sched.h"
+
+#define PRG_SIZE 0x4000
+#define CHR_SIZE 0x2000
+
+/* 16KB PRG + 8KB CHR 的 NROM 镜像 */
+static u8 image[CART_HEADER_SIZE + PRG_SIZE + CHR_SIZE] = {
+    'N', 'E', 'S', 0x1A, 0x01, 0x01, 0x01, 0x00,
+};
+
+static const u8 code[] = {
+    0x78,               // SEI
+    0xe8,               // INX
+    0x4c, 0x01, 0x80    // JMP $8001
+};
+
+#define N163_PRG_SIZE 0x10000
+#define N163_CHR_SIZE 0x4000
+
+/* 64KB PRG + 16KB CHR 的 mapper 19 镜像，每个 bank 的内容为 bank 号 */
+static u8 n163_image[CART_HEADER_SIZE + N163_PRG_SIZE + N163_CHR_SIZE] = {
+    'N', 'E', 'S', 0x1A, 0x04, 0x02, 0x30, 0x10,
+};
+
+/* 位于固定 bank 的程序：开中断后循环，IRQ 关闭计数器、计数后停在原地 */
+static const u8 n163_code[] = {
+    0x58,               // E000: CLI
+    0xe8,               // E001: INX
+    0x4c, 0x01, 0xe0,   // E002: JMP $E001
+    0xa9, 0x00,         // E005: LDA #$00
+    0x8d, 0x00, 0x58,   // E007: STA $5800
+    0xee, 0x00, 0x02,   // E00A: INC $0200
+    0x4c, 0x0d, 0xe0    // E00D: JMP $E00D
+};
+
+static void setup(void)
+{
+    u8 *prg = image + CART_HEADER_SIZE;
+    memcpy(prg, code, sizeof(code));
+    prg[0x3FFC] = 0x00;
+    prg[0x3FFD] = 0x80;
+    for (unsigned i = 0; i < CHR_SIZE; i++)
+        image[CART_HEADER_SIZE + PRG_SIZE + i] = i * 7;
+
+    cpu_init();
+    ram_init();
+    sched_reset();
+    LOG_ASSERT(ppu_init() != RET_ERR);
+    LOG_ASSERT(apu_init() != RET_ERR);
+}
+
+/* 文件头：iNES 与 NES 2.0 */
+static void test_parse(void)
+{
+    struct cart_info info;
+    u8 header[CART_HEADER_SIZE + 0x200 + PRG_SIZE] = {
+        'N', 'E', 'S', 0x1A, 0x01, 0x00, 0x3E, 0x18, 0x13, 0x00, 0x07, 0x07, 0x01,
+    };
+    /* NES 2.0：mapper 0x313，子 mapper 1，trainer，电池，四屏，PAL */
+    LOG_ASSERT(cart_parse(&info, header, sizeof(header)) == RET_OK);
+    LOG_ASSERT(info.nes2 && info.mapper == 0x313 && info.submapper == 1);
+    LOG_ASSERT(info.battery && info.mirror == PPU_MIRROR_FOUR && info.region == REGION_PAL);
+    LOG_ASSERT(info.trainer == header + CART_HEADER_SIZE);
+    LOG_ASSERT(info.prg == header + CART_HEADER_SIZE + 0x200 && info.prg_size == PRG_SIZE);
+    LOG_ASSERT(info.chr == NULL && info.prg_ram_size == 0x2000 && info.chr_ram_size == 0x2000);
+
+    /* 指数表示法：2^13 * 1 = 8KB */
+    header[4] = 13 << 2;
+    header[9] = 0x0F;
+    LOG_ASSERT(cart_parse(&info, header, sizeof(header)) == RET_OK && info.prg_size == 0x2000);
+
+    /* 旧式文件头第 12-15 字节有签名时忽略第 7 字节 */
+    memcpy(header + 7, "\xF0" "DiskDude!", 10);
+    header[4] = 1;
+    LOG_ASSERT(cart_parse(&info, header, sizeof(header)) == RET_OK);
+    LOG_ASSERT(!info.nes2 && info.mapper == 3);
+
+    LOG_ASSERT(cart_parse(&info, header, sizeof(header) - 1) == RET_ERR);
+    header[3] = 0;
+    LOG_ASSERT(cart_parse(&info, header, sizeof(header)) == RET_ERR);
+}
+
+/* PRG 直接映射，16KB 在 $C000 镜像，复位向量生效 */
+static void check_loaded(const u8 *data)
+{
+    const struct cart_info *info = cart_info();
+    LOG_ASSERT(info != NULL && info->prg == data + CART_HEADER_SIZE);
+    LOG_ASSERT(bus_read(0x8000) == 0x78 && bus_read(0xC000) == 0x78);
+    LOG_ASSERT(bus_read_direct(0xFFFC) == 0x00 && bus_read_direct(0xFFFD) == 0x80);
+    LOG_ASSERT(chr_cache_lookup(info->chr + CHR_BANK_SIZE) != NULL);
+
+    /* PRG-RAM 可读写，ROM 写入被忽略 */
+    bus_write(0x6000, 0x5A);
+    LOG_ASSERT(bus_read(0x6000) == 0x5A && bus_read_direct(0x6000) == 0x5A);
+    bus_write(0x8000, 0x00);
+    LOG_ASSERT(bus_read(0x8000) == 0x78);
+
+    sched_reset();
+    cpu_reset();
+    sched_run_frame();
+    LOG_ASSERT(bus_read(0x4F01) != 0);
+}
+
+static void test_load(void)
+{
+    setup();
+    LOG_ASSERT(cart_load(image, sizeof(image)) == RET_OK);
+    check_loaded(image);
+    cart_unload();
+    LOG_ASSERT(cart_info() == NULL);
+
+    /* 不支持的 mapper 不影响已加载的卡带 */
+    LOG_ASSERT(cart_load(image, sizeof(image)) == RET_OK);
+    image[6] = 0x11;
+    LOG_ASSERT(cart_load(image, sizeof(image)) == RET_ERR);
+    image[6] = 0x01;
+    LOG_ASSERT(cart_info() != NULL);
+    cart_unload();
+}
+
+/* Namco 163：PRG/CHR 切换、声音端口与 IRQ 计数器 */
+static void test_n163(void)
+{
+    u8 *prg = n163_image + CART_HEADER_SIZE, *chr = prg + N163_PRG_SIZE;
+    for (unsigned i = 0; i < N163_PRG_SIZE; i++)
+        prg[i] = i / 0x2000;
+    for (unsigned i = 0; i < N163_CHR_SIZE; i++)
+        chr[i] = i / CHR_BANK_SIZE;
+    memcpy(prg + N163_PRG_SIZE - 0x2000, n163_code, sizeof(n163_code));
+    prg[N163_PRG_SIZE - 4] = 0x00;
+    prg[N163_PRG_SIZE - 3] = 0xE0;
+    prg[N163_PRG_SIZE - 2] = 0x05;
+    prg[N163_PRG_SIZE - 1] = 0xE0;
+
+    setup();
+    LOG_ASSERT(cart_load(n163_image, sizeof(n163_image)) == RET_OK);
+    LOG_ASSERT(bus_read(0xE000) == 0x58 && bus_read(0x8000) == 0);
+    bus_write(0xE000, 5);
+    bus_write(0xE800, 0x40 | 6);
+    LOG_ASSERT(bus_read(0x8000) == 5 && bus_read_direct(0xA000) == 6);
+
+    /* PPU $0400 读到切换后的 CHR bank，读取有一字节缓冲 */
+    bus_write(0x8800, 11);
+    bus_write(0x2006, 0x04);
+    bus_write(0x2006, 0x00);
+    bus_read(0x2007);
+    LOG_ASSERT(bus_read(0x2007) == 11);
+
+    /* $4800 经自动递增地址访问内部 RAM */
+    bus_write(0xF800, 0x90);
+    bus_write(0x4800, 0x5A);
+    bus_write(0x4800, 0xA5);
+    bus_write(0xF800, 0x10);
+    LOG_ASSERT(bus_read(0x4800) == 0x5A);
+
+    /* 计数器每个 CPU 周期加 1，数到 $7FFF 时触发 IRQ，一帧内数不到 */
+    sched_reset();
+    cart_reset();
+    cpu_reset();
+    bus_write(0x4017, 0x40);
+    bus_write(0x0200, 0);
+    sched_run_frame();
+    LOG_ASSERT(bus_read(0x0200) == 0);
+    bus_write(0x5000, 0x00);
+    bus_write(0x5800, 0x80);
+    sched_run_frame();
+    LOG_ASSERT(bus_read(0x0200) == 0 && bus_read(0x5800) > 0xF0);
+    sched_run_frame();
+    LOG_ASSERT(bus_read(0x0200) == 1);
+    LOG_ASSERT(bus_read(0x5000) == 0xFF && bus_read(0x5800) == 0x00);
+    cart_unload();
+}
+
+/* 从文件只读映射 */
+static void test_load_file(void)
+{
+    char path[] = "/tmp/cart_XXXXXX";
+    int fd = mkstemp(path);
+    LOG_ASSERT(fd >= 0);
+    LOG_ASSERT(write(fd, image, sizeof(image)) == sizeof(image));
+    close(fd);
+
+    setup();
+    LOG_ASSERT(cart_load_file(path) == RET_OK);
+    const struct cart_info *info = cart_info();
+    LOG_ASSERT(info->prg != image + CART_HEADER_SIZE);
+    check_loaded(info->prg - CART_HEADER_SIZE);
+    cart_unload();
+    unlink(path);
+    LOG_ASSERT(cart_load_file(path) == RET_ERR);
+}
+
+int main()
+{
+    test_parse();
+    test_load();
+    test_n163();
+    test_load_file();
+    return 0;
+}
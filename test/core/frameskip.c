@@ -0,0 +1,137 @@
+#define LOG_IMPLEMENTATION
+#include <stdbool.h>
+#include "log.h"
+#include "libretro.h"
+#include "core/nes/cart.h"
+#include "core/nes/ppu.h"
+
+#define PRG_SIZE 0x4000
+
+/* 16KB PRG 的 NROM 镜像，CHR 使用 CHR-RAM */
+static u8 image[CART_HEADER_SIZE + PRG_SIZE] = {
+    'N', 'E', 'S', 0x1A, 0x01, 0x00, 0x00, 0x00,
+};
+
+static const u8 code[] = {
+    0x78,               // SEI
+    0xe8,               // INX
+    0x4c, 0x01, 0x80    // JMP $8001
+};
+
+static retro_audio_buffer_status_callback_t buffer_status;
+static int av_enable = 3;
+static bool video_null;
+
+static bool environ_cb(unsigned cmd, void *data)
+{
+    switch (cmd)
+    {
+    case RETRO_ENVIRONMENT_GET_VARIABLE:
+    {
+        struct retro_variable *var = data;
+        if(strcmp(var->key, "nes_frameskip"))
+            return false;
+        var->value = "auto";
+        return true;
+    }
+    case RETRO_ENVIRONMENT_GET_CAN_DUPE:
+        *(bool *)data = true;
+        return true;
+    case RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK:
+        buffer_status = data ? ((struct retro_audio_buffer_status_callback *)data)->callback : NULL;
+        return true;
+    case RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE:
+        *(int *)data = av_enable;
+        return true;
+    case RETRO_ENVIRONMENT_SET_VARIABLES:
+    case RETRO_ENVIRONMENT_SET_MINIMUM_AUDIO_LATENCY:
+    case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
+    case RETRO_ENVIRONMENT_SET_CONTENT_INFO_OVERRIDE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void video_cb(const void *data, unsigned width, unsigned height, size_t pitch)
+{
+    UNUSED(width);
+    UNUSED(height);
+    UNUSED(pitch);
+    video_null = data == NULL;
+}
+
+static size_t audio_cb(const int16_t *data, size_t frames)
+{
+    UNUSED(data);
+    return frames;
+}
+
+/* 前端在 retro_run 之前报告缓冲状态，返回本帧是否被跳过 */
+static bool run(bool underrun)
+{
+    buffer_status(true, underrun ? 5 : 50, underrun);
+    retro_run();
+    LOG_ASSERT(!ppu_frame_skipped() || video_null);
+    return ppu_frame_skipped();
+}
+
+/* 跳帧决定作用于同一帧，连续跳过的帧数有上限 */
+static void test_frameskip(void)
+{
+    LOG_ASSERT(buffer_status != NULL);
+    LOG_ASSERT(!run(false));
+    LOG_ASSERT(run(true));
+    LOG_ASSERT(!run(false));
+
+    int skipped = 0;
+    for (int frame = 0; frame < 4; frame++)
+        skipped += run(true);
+    LOG_ASSERT(skipped == 3);
+    LOG_ASSERT(!run(false));
+}
+
+/* 前端关闭视频的帧（run-ahead 等）不渲染，下一帧照常渲染 */
+static void test_video_disabled(void)
+{
+    av_enable = 2;
+    LOG_ASSERT(run(false));
+    av_enable = 3;
+    LOG_ASSERT(!run(false));
+    LOG_ASSERT(!video_null);
+}
+
+/* 制式选项为 auto 时使用 NES 2.0 文件头中的制式，加载后报告的帧率随之改变 */
+static void test_region(struct retro_game_info *game)
+{
+    struct retro_system_av_info info;
+    retro_get_system_av_info(&info);
+    LOG_ASSERT(info.timing.fps > 59);
+
+    retro_unload_game();
+    image[7] = 0x08;
+    image[12] = 0x01;
+    LOG_ASSERT(retro_load_game(game));
+    retro_get_system_av_info(&info);
+    LOG_ASSERT(info.timing.fps < 51);
+    LOG_ASSERT(!run(false));
+}
+
+int main()
+{
+    struct retro_game_info game = { NULL, image, sizeof(image), NULL };
+    memcpy(image + CART_HEADER_SIZE, code, sizeof(code));
+    image[CART_HEADER_SIZE + 0x3FFD] = 0x80;
+
+    retro_set_environment(environ_cb);
+    retro_set_video_refresh(video_cb);
+    retro_set_audio_sample_batch(audio_cb);
+    retro_init();
+    LOG_ASSERT(retro_load_game(&game));
+    test_frameskip();
+    test_video_disabled();
+    test_region(&game);
+    retro_unload_game();
+    retro_deinit();
+    return 0;
+}
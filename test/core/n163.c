@@ -0,0 +1,123 @@
+#define LOG_IMPLEMENTATION
+#include <time.h>
+#include "log.h"
+#include "core/nes/n163.h"
+#include "apu_test.h"
+
+static struct n163 chip;
+
+static void setup_chip(void)
+{
+    setup();
+    LOG_ASSERT(n163_init(&chip) == RET_OK);
+    bus_write(0x4017, 0x40);
+}
+
+/* 从 addr 开始自动递增写入 RAM */
+static void poke(u8 addr, const u8 *data, unsigned len)
+{
+    n163_write(&chip, 0xF800, 0x80 | addr);
+    for (unsigned i = 0; i < len; i++)
+        n163_write(&chip, 0x4800, data[i]);
+}
+
+/* 设置声道：波表从 0 开始，16 个采样 */
+static void channel(unsigned ch, u32 freq, u8 volume, u8 count)
+{
+    u8 reg[8] = {
+        freq, 0, freq >> 8, 0, 0xF0 | ((freq >> 16) & 0x03), 0, 0x00,
+        volume | (ch == 7 ? (count - 1) << 4 : 0),
+    };
+    poke(0x40 + ch * 8, reg, sizeof(reg));
+}
+
+/* RAM 读写与自动递增 */
+static void test_ram(void)
+{
+    const u8 data[] = {0x12, 0x34, 0x56};
+    setup_chip();
+    poke(0x10, data, sizeof(data));
+    n163_write(&chip, 0xF800, 0x90);
+    for (unsigned i = 0; i < sizeof(data); i++)
+        LOG_ASSERT(n163_read(&chip, 0x4800) == data[i]);
+    n163_write(&chip, 0xF800, 0x10);
+    LOG_ASSERT(n163_read(&chip, 0x4800) == data[0]);
+    LOG_ASSERT(n163_read(&chip, 0x4800) == data[0]);
+    n163_remove(&chip);
+}
+
+/* 方波波表的频率：freq * CPU / (15 * 65536 * 声道数 * 长度) */
+static void test_tone(void)
+{
+    const u8 wave[8] = {0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00};
+    const u32 freq = 3870;
+    unsigned total;
+
+    setup_chip();
+    poke(0x00, wave, sizeof(wave));
+    channel(7, freq, 0x0F, 1);
+    run_frame();
+    double hz = measure_hz(60, &total);
+    double expect = freq * CPU_HZ / (15.0 * 65536 * 16);
+    LOG("n163: %.1f Hz (expect %.1f Hz)", hz, expect);
+    LOG_ASSERT(hz > expect - 2 && hz < expect + 2);
+
+    /* 关闭声音后保持电平，直流被高通滤除；卸下后不再运行 */
+    n163_write(&chip, 0xE000, 0x40);
+    for (int frame = 0; frame < 60; frame++)
+        run_frame();
+    LOG_ASSERT(samples[0] < 200 && samples[0] > -200);
+    n163_remove(&chip);
+}
+
+/* 8 声道全开时轮流更新每个声道，波表区不被改写 */
+static void test_channels(void)
+{
+    u8 wave[N163_REG_BASE];
+    for (unsigned i = 0; i < sizeof(wave); i++)
+        wave[i] = i * 37;
+
+    setup_chip();
+    poke(0x00, wave, sizeof(wave));
+    for (unsigned ch = 0; ch < N163_CH_NUM; ch++)
+        channel(ch, 1, 0x0F, 8);
+    run_frame();
+    /* 一帧约 1985 次更新，每个声道约 248 次，频率为 1 时相位即更新次数 */
+    for (unsigned ch = 0; ch < N163_CH_NUM; ch++)
+    {
+        const u8 *reg = chip.ram + N163_REG_BASE + ch * 8;
+        u32 phase = reg[1] | reg[3] << 8 | reg[5] << 16;
+        LOG_ASSERT(phase > 240 && phase < 256);
+    }
+    LOG_ASSERT(!memcmp(chip.ram, wave, sizeof(wave)));
+    n163_remove(&chip);
+}
+
+/* 8 声道的开销：每帧约 2000 次声道更新，连同 CPU 也远快于实时 */
+static void test_speed(void)
+{
+    const u8 wave[8] = {0x8F, 0x3C, 0xA1, 0x07, 0x5E, 0xD2, 0x69, 0xB4};
+    struct timespec begin, end;
+
+    setup_chip();
+    poke(0x00, wave, sizeof(wave));
+    for (unsigned ch = 0; ch < N163_CH_NUM; ch++)
+        channel(ch, 1000 + ch * 777, 0x0F, 8);
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int frame = 0; frame < 60; frame++)
+        run_frame();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double us = ((end.tv_sec - begin.tv_sec) * 1e9 + (end.tv_nsec - begin.tv_nsec)) / 1e3 / 60;
+    LOG("n163 x8: %.1f us per frame (including CPU)", us);
+    LOG_ASSERT(us < 1e6 / g_sched.timing->fps / 4);
+    n163_remove(&chip);
+}
+
+int main()
+{
+    test_ram();
+    test_tone();
+    test_channels();
+    test_speed();
+    return 0;
+}
@@ -0,0 +1,68 @@
+#define LOG_IMPLEMENTATION
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+#include "core/nes/ntsc.h"
+#include "core/nes/palette.h"
+#include "core/nes/pixel.h"
+
+static u16 idx[PPU_WIDTH * PPU_HEIGHT];
+static u32 expect[NTSC_WIDTH * PPU_HEIGHT];
+static u32 out[NTSC_WIDTH * PPU_HEIGHT];
+static u16 out16[NTSC_WIDTH * PPU_HEIGHT];
+
+/* 单色画面解码后接近调色板颜色 */
+static void test_flat(void)
+{
+    const u32 *lut = palette_table(PALETTE_XRGB8888);
+    for (u16 color = 0; color < PALETTE_COLORS; color++)
+    {
+        for (unsigned i = 0; i < PPU_WIDTH * PPU_HEIGHT; i++)
+            idx[i] = color;
+        ntsc_filter(out, NTSC_WIDTH * sizeof(u32), sizeof(u32), idx, 0, PPU_HEIGHT, 0);
+        u32 rgb = out[100 * NTSC_WIDTH + 200];
+        for (unsigned shift = 0; shift < 24; shift += 8)
+            LOG_ASSERT(abs((int)((rgb >> shift) & 0xFF) - (int)((lut[color] >> shift) & 0xFF)) < 48);
+    }
+}
+
+int main(void)
+{
+    srand(1);
+    palette_init();
+    ntsc_init();
+    LOG_ASSERT(pixel_select(PIXEL_KERNEL_SCALAR) == RET_OK);
+    test_flat();
+
+    for (unsigned i = 0; i < PPU_WIDTH * PPU_HEIGHT; i++)
+        idx[i] = rand() % PALETTE_SIZE;
+    ntsc_filter(expect, NTSC_WIDTH * sizeof(u32), sizeof(u32), idx, 0, PPU_HEIGHT, 1);
+
+    /* 各向量内核与分段线程的结果与标量一致 */
+    for (int kernel = 0; kernel < PIXEL_KERNEL_NUM; kernel++)
+    {
+        if(pixel_select(kernel) != RET_OK)
+            continue;
+        for (unsigned threads = 1; threads <= 4; threads *= 2)
+        {
+            LOG_ASSERT(ntsc_set_threads(threads) == RET_OK);
+            memset(out, 0, sizeof(out));
+            ntsc_filter(out, NTSC_WIDTH * sizeof(u32), sizeof(u32), idx, 0, PPU_HEIGHT, 1);
+            LOG_ASSERT(!memcmp(out, expect, sizeof(out)));
+        }
+
+        /* RGB565 与裁剪 */
+        ntsc_filter(out16, NTSC_WIDTH * sizeof(u16), sizeof(u16), idx, 8, PPU_HEIGHT - 16, 1);
+        for (unsigned y = 0; y < PPU_HEIGHT - 16; y++)
+        {
+            for (unsigned x = 0; x < NTSC_WIDTH; x++)
+            {
+                u32 rgb = expect[(y + 8) * NTSC_WIDTH + x];
+                LOG_ASSERT(out16[y * NTSC_WIDTH + x] == (((rgb >> 8) & 0xF800) | ((rgb >> 5) & 0x07E0) | ((rgb >> 3) & 0x1F)));
+            }
+        }
+    }
+    LOG_ASSERT(ntsc_set_threads(1) == RET_OK);
+    LOG("ntsc: pass");
+    return 0;
+}
@@ -0,0 +1,67 @@
+#define LOG_IMPLEMENTATION
+#include <stdlib.h>
+#include "log.h"
+#include "core/nes/pixel.h"
+
+#define PIXELS 256
+#define COLORS 512
+
+static u8 bg[PIXELS];
+static u8 spr[PIXELS];
+static u16 lut[0x20];
+static u16 expect[PIXELS + 1];
+static u16 out[PIXELS + 1];
+static u16 idx[PIXELS];
+static u32 colors[COLORS];
+static u32 expect32[PIXELS + 1];
+static u32 out32[PIXELS + 1];
+
+/* 随机生成背景与精灵，覆盖透明、优先级与 0 号精灵标记 */
+static void fill(void)
+{
+    for (unsigned x = 0; x < PIXELS; x++)
+    {
+        bg[x] = (rand() & 1) ? rand() & 0x0F : 0;
+        spr[x] = (rand() & 1) ? 0x10 | (rand() & 0x6F) : 0;
+        idx[x] = rand() % COLORS;
+    }
+    for (unsigned i = 0; i < 0x20; i++)
+        lut[i] = rand() % COLORS;
+    for (unsigned i = 0; i < COLORS; i++)
+        colors[i] = rand() & 0xFFFF;
+}
+
+int main(void)
+{
+    srand(1);
+    LOG_ASSERT(pixel_select(PIXEL_KERNEL_SCALAR) == RET_OK);
+    for (unsigned round = 0; round < 64; round++)
+    {
+        fill();
+        /* 长度不是向量宽度整数倍时尾部走标量路径 */
+        unsigned n = PIXELS - (round % 33);
+        pixel_select(PIXEL_KERNEL_SCALAR);
+        expect[n] = out[n] = 0xBEEF;
+        expect32[n] = out32[n] = 0xDEADBEEF;
+        pixel_compose(expect, bg, spr, lut, n);
+        pixel_convert(expect32, idx, colors, n, sizeof(u32));
+        for (int kernel = 0; kernel < PIXEL_KERNEL_NUM; kernel++)
+        {
+            if(pixel_select(kernel) != RET_OK)
+                continue;
+            pixel_compose(out, bg, spr, lut, n);
+            for (unsigned x = 0; x <= n; x++)
+                LOG_ASSERT(out[x] == expect[x]);
+            pixel_convert(out32, idx, colors, n, sizeof(u32));
+            for (unsigned x = 0; x <= n; x++)
+                LOG_ASSERT(out32[x] == expect32[x]);
+            pixel_convert(out, idx, colors, n, sizeof(u16));
+            for (unsigned x = 0; x < n; x++)
+                LOG_ASSERT(out[x] == expect32[x]);
+            LOG_ASSERT(out[n] == expect[n]);
+        }
+    }
+    pixel_init();
+    LOG("pixel: pass, %d", pixel_kernel());
+    return 0;
+}
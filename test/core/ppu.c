@@ -0,0 +1,443 @@
+#define LOG_IMPLEMENTATION
+#include "log.h"
+#include "core/nes/cpu.h"
+#include "core/nes/bus.h"
+#include "core/nes/chr.h"
+#include "core/nes/palette.h"
+#include "core/nes/ppu.h"
+#include "core/nes/ram.h"
+#include "core/nes/sched.h"
+
+#define WHITE 0xFFFEFF
+#define BLACK 0x000000
+#define RED   0xB53120
+
+#define DOT_CYCLES (g_sched.timing->ppu_div)
+#define LINE_CYCLES ((u64)REGION_DOTS_PER_LINE * DOT_CYCLES)
+
+u8 rom[] = {
+    0x4c, 0x00, 0x00    // JMP $0000
+};
+
+static u32 reference[PPU_WIDTH * PPU_HEIGHT];
+static char split_name[] = "split";
+static event_id split_event;
+static u8 split_mask[2];
+static u64 split_line;
+static u64 frame_start;
+
+static void ppu_addr(u16 addr)
+{
+    bus_write(0x2006, addr >> 8);
+    bus_write(0x2006, addr & 0xFF);
+}
+
+/* 在指定扫描线中间写 $2001 */
+static void split_fire(u64 when)
+{
+    UNUSED(when);
+    if(split_mask[0] != split_mask[1])
+    {
+        /* 先在行中关闭渲染，下一行开始前恢复 */
+        bus_write(0x2001, split_mask[split_line & 1]);
+        if(!(split_line++ & 1))
+            sched_event_schedule(split_event, frame_start + 61 * LINE_CYCLES);
+        return;
+    }
+    bus_write(0x2001, split_mask[0]);
+    if(++split_line < PPU_HEIGHT)
+        sched_event_schedule(split_event, frame_start + split_line * LINE_CYCLES + 100 * DOT_CYCLES);
+}
+
+static void setup(void)
+{
+    sched_reset();
+    LOG_ASSERT(ppu_init() != RET_ERR);
+
+    /* 调色板：背景 0x0F，背景色 1 为白色，精灵色 1 为红色 */
+    ppu_addr(0x3F00);
+    bus_write(0x2007, 0x0F);
+    bus_write(0x2007, 0x30);
+    ppu_addr(0x3F11);
+    bus_write(0x2007, 0x16);
+
+    /* 图块 1 全部为颜色 1 */
+    ppu_addr(0x0010);
+    for (int i = 0; i < 8; i++)
+        bus_write(0x2007, 0xFF);
+    for (int i = 0; i < 8; i++)
+        bus_write(0x2007, 0x00);
+
+    /* 名称表上半部分使用图块 1 */
+    ppu_addr(0x2000);
+    for (int i = 0; i < 0x3C0; i++)
+        bus_write(0x2007, i < 15 * 32 ? 1 : 0);
+
+    /* 0 号精灵位于 (100, 50) */
+    bus_write(0x2003, 0);
+    bus_write(0x2004, 49);
+    bus_write(0x2004, 1);
+    bus_write(0x2004, 0);
+    bus_write(0x2004, 100);
+    for (int i = 4; i < 256; i++)
+        bus_write(0x2004, 0xF0);
+
+    ppu_addr(0x0000);
+    bus_write(0x2005, 0);
+    bus_write(0x2005, 0);
+    bus_write(0x2001, 0x1E);
+}
+
+static void test_frame(void)
+{
+    setup();
+    sched_run_frame();
+    const u32 *frame = ppu_frame();
+    LOG_ASSERT(frame[0] == WHITE);
+    LOG_ASSERT(frame[119 * PPU_WIDTH + 255] == WHITE);
+    LOG_ASSERT(frame[120 * PPU_WIDTH] == BLACK);
+    LOG_ASSERT(frame[50 * PPU_WIDTH + 100] == RED);
+    LOG_ASSERT(frame[50 * PPU_WIDTH + 108] == WHITE);
+    LOG_ASSERT(frame[49 * PPU_WIDTH + 100] == WHITE);
+    LOG_ASSERT(ppu_frame_index()[0] == 0x30);
+    LOG_ASSERT(ppu_frame_index()[50 * PPU_WIDTH + 100] == 0x16);
+    memcpy(reference, frame, sizeof(reference));
+
+    /* 第二帧 0 号精灵命中，vblank 期间读取状态 */
+    sched_run_frame();
+    LOG_ASSERT(!memcmp(reference, ppu_frame(), sizeof(reference)));
+}
+
+static char poll_name[] = "poll";
+static event_id poll_event;
+static u8 poll_status[2];
+static int poll_count;
+
+static void poll_fire(u64 when)
+{
+    poll_status[poll_count++] = bus_read(0x2002);
+    if(poll_count < 2)
+        sched_event_schedule(poll_event, when + 100 * DOT_CYCLES);
+}
+
+/* 0 号精灵命中在命中点之后才可见 */
+static void test_sprite_zero(void)
+{
+    setup();
+    poll_count = 0;
+    poll_event = sched_event_register(poll_name, poll_fire);
+    sched_event_schedule(poll_event, g_sched.clock + 50 * LINE_CYCLES + 50 * DOT_CYCLES);
+    sched_run_frame();
+    sched_event_remove(poll_event);
+    LOG_ASSERT(poll_count == 2);
+    LOG_ASSERT(!(poll_status[0] & 0x40));
+    LOG_ASSERT(poll_status[1] & 0x40);
+}
+
+/* 运行一帧，在第 200 行读取状态 */
+static u8 run_overflow_poll(void)
+{
+    poll_count = 1;
+    poll_event = sched_event_register(poll_name, poll_fire);
+    sched_event_schedule(poll_event, g_sched.clock + 200 * LINE_CYCLES);
+    sched_run_frame();
+    sched_event_remove(poll_event);
+    return poll_status[1];
+}
+
+static void test_sprite_limit(void)
+{
+    /* 第 150 行有 9 个精灵 */
+    setup();
+    bus_write(0x2003, 4);
+    for (int i = 1; i <= 9; i++)
+    {
+        bus_write(0x2004, 149);
+        bus_write(0x2004, 1);
+        bus_write(0x2004, 0);
+        bus_write(0x2004, i * 16);
+    }
+    LOG_ASSERT(run_overflow_poll() & 0x20);
+    LOG_ASSERT(ppu_frame()[150 * PPU_WIDTH + 128] == RED);
+    LOG_ASSERT(ppu_frame()[150 * PPU_WIDTH + 144] == BLACK);
+
+    /* 取消限制后第 9 个精灵可见，溢出标志不变 */
+    ppu_set_sprite_limit(0);
+    LOG_ASSERT(run_overflow_poll() & 0x20);
+    LOG_ASSERT(ppu_frame()[150 * PPU_WIDTH + 144] == RED);
+    ppu_set_sprite_limit(1);
+}
+
+/* 仅时序模式不输出像素，0 号精灵命中时间不变 */
+static void test_skip(void)
+{
+    static u32 data[PPU_WIDTH * PPU_HEIGHT];
+    struct ppu_surface surface = { data, PPU_WIDTH * sizeof(u32), sizeof(u32), 0, PPU_HEIGHT };
+
+    setup();
+    ppu_set_skip(1);
+    memset(data, 0xAA, sizeof(data));
+    ppu_set_surface(&surface);
+    poll_count = 0;
+    poll_event = sched_event_register(poll_name, poll_fire);
+    sched_event_schedule(poll_event, g_sched.clock + 50 * LINE_CYCLES + 50 * DOT_CYCLES);
+    sched_run_frame();
+    sched_event_remove(poll_event);
+    LOG_ASSERT(ppu_frame_skipped());
+    LOG_ASSERT(!(poll_status[0] & 0x40));
+    LOG_ASSERT(poll_status[1] & 0x40);
+    LOG_ASSERT(data[0] == 0xAAAAAAAA && data[50 * PPU_WIDTH + 100] == 0xAAAAAAAA);
+
+    /* 帧之间的设置对紧接着的一帧生效，恢复渲染后的第一帧视为有变化 */
+    ppu_set_skip(0);
+    sched_run_frame();
+    LOG_ASSERT(!ppu_frame_skipped());
+    LOG_ASSERT(ppu_frame_dirty());
+    LOG_ASSERT(ppu_frame()[50 * PPU_WIDTH + 100] == RED);
+    ppu_set_skip(1);
+    sched_run_frame();
+    LOG_ASSERT(ppu_frame_skipped());
+    ppu_set_skip(0);
+    sched_run_frame();
+    LOG_ASSERT(!ppu_frame_skipped());
+}
+
+/* 行内写入相同的值走逐点路径，结果应与整行路径一致 */
+static void test_split_same(void)
+{
+    /* 带精细滚动并跨越名称表 */
+    setup();
+    bus_write(0x2005, 109);
+    bus_write(0x2005, 3);
+    sched_run_frame();
+    memcpy(reference, ppu_frame(), sizeof(reference));
+
+    setup();
+    bus_write(0x2005, 109);
+    bus_write(0x2005, 3);
+    frame_start = g_sched.clock;
+    split_mask[0] = split_mask[1] = 0x1E;
+    split_line = 0;
+    split_event = sched_event_register(split_name, split_fire);
+    sched_event_schedule(split_event, frame_start + 100 * DOT_CYCLES);
+    sched_run_frame();
+    sched_event_remove(split_event);
+    LOG_ASSERT(split_line == PPU_HEIGHT);
+    LOG_ASSERT(!memcmp(reference, ppu_frame(), sizeof(reference)));
+}
+
+/* 行内关闭渲染，剩余像素为背景色 */
+static void test_split_disable(void)
+{
+    setup();
+    frame_start = g_sched.clock;
+    split_mask[0] = 0x00;
+    split_mask[1] = 0x1E;
+    split_line = 0;
+    split_event = sched_event_register(split_name, split_fire);
+    sched_event_schedule(split_event, frame_start + 60 * LINE_CYCLES + 128 * DOT_CYCLES);
+    sched_run_frame();
+    sched_event_remove(split_event);
+    const u32 *frame = ppu_frame();
+    LOG_ASSERT(frame[60 * PPU_WIDTH + 100] == WHITE);
+    LOG_ASSERT(frame[60 * PPU_WIDTH + 200] == BLACK);
+    LOG_ASSERT(frame[61 * PPU_WIDTH + 200] == WHITE);
+}
+
+/* 映射已缓存的 CHR-ROM bank 后渲染使用新 bank 的解码结果 */
+static void test_chr_bank(void)
+{
+    static u8 chr_rom[CHR_BANK_SIZE * 2];
+
+    /* bank 1 的图块 1 为颜色 2 */
+    memset(chr_rom, 0, sizeof(chr_rom));
+    memset(chr_rom + CHR_BANK_SIZE + 0x18, 0xFF, 8);
+
+    setup();
+    LOG_ASSERT(chr_cache_attach(chr_rom, sizeof(chr_rom)) == RET_OK);
+    LOG_ASSERT(chr_cache_lookup(chr_rom + CHR_BANK_SIZE) != NULL);
+    ppu_addr(0x3F02);
+    bus_write(0x2007, 0x16);
+    ppu_addr(0x0000);
+    ppu_map_chr(0, chr_rom + CHR_BANK_SIZE, 0);
+    sched_run_frame();
+    LOG_ASSERT(ppu_frame()[0] == RED);
+
+    /* 只读 bank 不可写 */
+    ppu_addr(0x0018);
+    bus_write(0x2007, 0x00);
+    LOG_ASSERT(chr_rom[CHR_BANK_SIZE + 0x18] == 0xFF);
+
+    /* 恢复 CHR-RAM 后写入立即更新解码结果 */
+    ppu_map_chr(0, NULL, 1);
+    ppu_addr(0x0018);
+    for (int i = 0; i < 8; i++)
+        bus_write(0x2007, 0xFF);
+    ppu_addr(0x0000);
+    sched_run_frame();
+    LOG_ASSERT(ppu_frame()[0] == 0x666666);
+}
+
+/* 强调位与 16 位输出格式都通过查找表完成 */
+static void test_palette(void)
+{
+    u16 white = PALETTE_INDEX(g_sched.region == REGION_NTSC ? 1 : 2, 0x30);
+
+    setup();
+    bus_write(0x2001, 0x3E);
+    sched_run_frame();
+    LOG_ASSERT(ppu_frame()[0] == palette_table(PALETTE_XRGB8888)[white]);
+    LOG_ASSERT(ppu_frame()[0] != WHITE);
+
+    palette_set_format(PALETTE_RGB565);
+    sched_run_frame();
+    LOG_ASSERT(ppu_frame()[0] == palette_table(PALETTE_RGB565)[white]);
+    LOG_ASSERT(ppu_frame()[120 * PPU_WIDTH] == 0);
+    palette_set_format(PALETTE_XRGB8888);
+}
+
+/* 直接写入带裁剪与自定义行距的 16 位外部画面 */
+static void test_surface(void)
+{
+    static u16 data[300 * 224];
+    struct ppu_surface surface = { data, 300 * sizeof(u16), sizeof(u16), 8, 224 };
+    const u32 *rgb565 = palette_table(PALETTE_RGB565);
+
+    setup();
+    palette_set_format(PALETTE_RGB565);
+    memset(data, 0xAA, sizeof(data));
+    ppu_set_surface(&surface);
+    sched_run_frame();
+    LOG_ASSERT((void *)ppu_frame() == (void *)data);
+    LOG_ASSERT(data[0] == rgb565[0x30]);
+    LOG_ASSERT(data[111 * 300 + 255] == rgb565[0x30]);
+    LOG_ASSERT(data[112 * 300] == rgb565[0x0F]);
+    LOG_ASSERT(data[42 * 300 + 100] == rgb565[0x16]);
+    LOG_ASSERT(data[223 * 300 + 256] == 0xAAAA);
+
+    /* 帧完成后恢复为内部缓冲 */
+    palette_set_format(PALETTE_XRGB8888);
+    sched_run_frame();
+    LOG_ASSERT(ppu_frame()[0] == WHITE);
+}
+
+static char vblank_name[] = "vblank write";
+static u8 vblank_color;
+
+/* 在 vblank 期间写调色板并恢复滚动，与游戏的常规做法一致 */
+static void vblank_fire(u64 when)
+{
+    UNUSED(when);
+    ppu_addr(0x3F01);
+    bus_write(0x2007, vblank_color);
+    bus_write(0x2001, 0x1E);
+    ppu_addr(0x0000);
+    bus_write(0x2005, 0);
+    bus_write(0x2005, 0);
+}
+
+static int run_vblank_write(u8 color)
+{
+    event_id id = sched_event_register(vblank_name, vblank_fire);
+    vblank_color = color;
+    sched_event_schedule(id, g_sched.frame_end + (g_sched.timing->vblank_line + 4) * LINE_CYCLES);
+    sched_run_frame();
+    sched_event_remove(id);
+    sched_run_frame();
+    return ppu_frame_dirty();
+}
+
+/* 静态画面判定为未变化，写入相同的值不算变化 */
+static void test_dirty(void)
+{
+    setup();
+    sched_run_frame();
+    LOG_ASSERT(ppu_frame_dirty());
+    sched_run_frame();
+    sched_run_frame();
+    LOG_ASSERT(!ppu_frame_dirty());
+
+    LOG_ASSERT(!run_vblank_write(0x30));
+    LOG_ASSERT(run_vblank_write(0x16));
+    sched_run_frame();
+    LOG_ASSERT(!ppu_frame_dirty());
+
+    /* 每帧相同的行内写入不算变化 */
+    split_mask[0] = split_mask[1] = 0x1E;
+    split_event = sched_event_register(split_name, split_fire);
+    for (int i = 0; i < 3; i++)
+    {
+        frame_start = g_sched.frame_end;
+        split_line = PPU_HEIGHT - 2;
+        sched_event_schedule(split_event, frame_start + split_line * LINE_CYCLES + 100 * DOT_CYCLES);
+        sched_run_frame();
+        LOG_ASSERT(split_line == PPU_HEIGHT);
+    }
+    sched_event_remove(split_event);
+    LOG_ASSERT(!ppu_frame_dirty());
+}
+
+static void test_pipeline(void)
+{
+    static u8 chr_rom[CHR_BANK_SIZE];
+
+    /* 校验模式：行内关闭渲染、切换 CHR bank 后两条路径的结果一致 */
+    memset(chr_rom, 0x55, sizeof(chr_rom));
+    setup();
+    LOG_ASSERT(ppu_pipeline(PPU_PIPELINE_VALIDATE) == RET_OK);
+    frame_start = g_sched.clock;
+    split_mask[0] = 0x00;
+    split_mask[1] = 0x1E;
+    split_line = 0;
+    split_event = sched_event_register(split_name, split_fire);
+    sched_event_schedule(split_event, frame_start + 60 * LINE_CYCLES + 128 * DOT_CYCLES);
+    sched_run_frame();
+    sched_event_remove(split_event);
+    ppu_pipeline_submit();
+    LOG_ASSERT(ppu_frame()[61 * PPU_WIDTH + 200] == WHITE);
+    ppu_map_chr(0, chr_rom, 0);
+    for (int i = 0; i < 3; i++)
+    {
+        sched_run_frame();
+        ppu_pipeline_submit();
+    }
+    LOG_ASSERT(ppu_pipeline_mismatches() == 0);
+
+    /* 工作线程模式：画面比模拟晚一帧 */
+    ppu_map_chr(0, NULL, 1);
+    LOG_ASSERT(ppu_pipeline(PPU_PIPELINE_ON) == RET_OK);
+    sched_run_frame();
+    ppu_pipeline_submit();
+    sched_run_frame();
+    ppu_pipeline_submit();
+    LOG_ASSERT(ppu_frame()[0] == WHITE);
+    LOG_ASSERT(ppu_frame()[50 * PPU_WIDTH + 100] == RED);
+    LOG_ASSERT(ppu_pipeline(PPU_PIPELINE_OFF) == RET_OK);
+}
+
+int main()
+{
+    palette_init();
+    LOG_ASSERT(cpu_init() != RET_ERR);
+    LOG_ASSERT(ram_init() != RET_ERR);
+    for (size_t i = 0; i < sizeof(rom); i++)
+        bus_write(i, rom[i]);
+
+    for (enum region region = 0; region < REGION_NUM; region++)
+    {
+        sched_set_region(region);
+        test_frame();
+        test_sprite_zero();
+        test_sprite_limit();
+        test_skip();
+        test_split_same();
+        test_split_disable();
+        test_chr_bank();
+        test_palette();
+        test_surface();
+        test_dirty();
+        test_pipeline();
+        LOG("%s ok", g_sched.timing->name);
+    }
+    return 0;
+}
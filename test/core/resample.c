@@ -0,0 +1,91 @@
+#define LOG_IMPLEMENTATION
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+#include "log.h"
+#include "core/nes/resample.h"
+
+#define SAMPLES 1000
+#define RATE 48000.0
+
+static s16 in[SAMPLES];
+static s16 expect[SAMPLES * RESAMPLE_MAX_RATIO * 2];
+static s16 out[SAMPLES * RESAMPLE_MAX_RATIO * 2];
+static struct resample r;
+
+/* 分两段处理，验证段间历史采样衔接 */
+static void run(unsigned ratio, s16 *dst)
+{
+    unsigned n = resample_run(&r, dst, in, SAMPLES / 3);
+    n += resample_run(&r, dst + n * 2, in + SAMPLES / 3, SAMPLES - SAMPLES / 3);
+    LOG_ASSERT(n == SAMPLES * ratio);
+}
+
+/* 各指令集实现逐位相同 */
+static void test_kernels(void)
+{
+    for (unsigned i = 0; i < SAMPLES; i++)
+        in[i] = rand();
+    for (unsigned ratio = 1; ratio <= RESAMPLE_MAX_RATIO; ratio++)
+    {
+        resample_init(&r, ratio);
+        LOG_ASSERT(resample_select(&r, SIMD_SCALAR) == RET_OK);
+        run(ratio, expect);
+        for (int level = 0; level < SIMD_LEVEL_NUM; level++)
+        {
+            resample_init(&r, ratio);
+            if(resample_select(&r, level) != RET_OK)
+                continue;
+            memset(out, 0, sizeof(out));
+            run(ratio, out);
+            for (unsigned i = 0; i < SAMPLES * ratio * 2; i++)
+                LOG_ASSERT(out[i] == expect[i]);
+        }
+    }
+}
+
+/* 通带内的正弦插值后与理想波形一致，输出延迟 8 个输入采样 */
+static void test_sine(void)
+{
+    const double freq = 3000, amp = 12000;
+    for (unsigned i = 0; i < SAMPLES; i++)
+        in[i] = lrint(amp * sin(2 * M_PI * freq * i / RATE));
+    for (unsigned ratio = 2; ratio <= RESAMPLE_MAX_RATIO; ratio++)
+    {
+        double error = 0;
+        resample_init(&r, ratio);
+        run(ratio, out);
+        for (unsigned j = 32 * ratio; j < SAMPLES * ratio; j++)
+        {
+            double t = (double)j / ratio - RESAMPLE_TAPS / 2;
+            double ideal = amp * sin(2 * M_PI * freq * t / RATE);
+            error = MAX(error, fabs(out[j * 2] - ideal));
+            LOG_ASSERT(out[j * 2] == out[j * 2 + 1]);
+        }
+        LOG("ratio %u: max error %.1f", ratio, error);
+        LOG_ASSERT(error < amp * 0.01);
+    }
+}
+
+/* 一帧 800 个采样升采样的耗时，应远小于这些采样的播放时长 */
+static void test_speed(void)
+{
+    struct timespec begin, end;
+    resample_init(&r, 2);
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int i = 0; i < 1000; i++)
+        resample_run(&r, out, in, 800);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double us = ((end.tv_sec - begin.tv_sec) * 1e9 + (end.tv_nsec - begin.tv_nsec)) / 1e3 / 1000;
+    LOG("800 samples x2: %.2f us per frame", us);
+    LOG_ASSERT(us < 800 / RATE * 1e6 / 10);
+}
+
+int main(void)
+{
+    srand(1);
+    test_kernels();
+    test_sine();
+    test_speed();
+    return 0;
+}
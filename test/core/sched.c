@@ -0,0 +1,127 @@
+#define LOG_IMPLEMENTATION
+#include "log.h"
+#include "core/nes/cpu.h"
+#include "core/nes/bus.h"
+#include "core/nes/ram.h"
+#include "core/nes/sched.h"
+
+#define LINE_CYCLES ((u64)REGION_DOTS_PER_LINE * g_sched.timing->ppu_div)
+
+u8 rom[] = {
+    0xe8,               // INX
+    0x4c, 0x00, 0x00    // JMP $0000
+};
+
+static char line_name[] = "line counter";
+static char line_event_name[] = "line end";
+static char dummy_event_name[] = "dummy";
+static sched_id line_id;
+static event_id line_event;
+static u64 lines;
+static u64 synced;
+
+/* 模拟按扫描线边界同步的设备 */
+static void line_sync(u64 until)
+{
+    while ((lines + 1) * LINE_CYCLES <= until)
+        lines++;
+    synced = until;
+}
+
+static void line_fire(u64 when)
+{
+    line_sync(when);
+    sched_event_schedule(line_event, when + LINE_CYCLES);
+}
+
+static void dummy_fire(u64 when)
+{
+    UNUSED(when);
+    LOG_ASSERT(0);
+}
+
+/* 乱序调度、改期与取消后事件仍按时刻顺序触发 */
+static u64 order_last;
+static int order_count;
+static void order_fire(u64 when)
+{
+    LOG_ASSERT(when >= order_last);
+    order_last = when;
+    order_count++;
+}
+
+static void test_event_order(void)
+{
+    static char name[] = "order";
+    event_id ids[16];
+    for (int i = 0; i < 16; i++)
+    {
+        ids[i] = sched_event_register(name, order_fire);
+        LOG_ASSERT(ids[i] != RET_ERR);
+        sched_event_schedule(ids[i], 1000 + (i * 7919) % 16 * 100);
+    }
+    sched_event_reschedule(ids[3], 10);
+    sched_event_reschedule(ids[5], 5000);
+    sched_event_cancel(ids[7]);
+    LOG_ASSERT(!sched_event_pending(ids[7]));
+    LOG_ASSERT(sched_event_time(ids[3]) == 10);
+
+    sched_run_frame();
+    LOG_ASSERT(order_count == 15);
+    for (int i = 0; i < 16; i++)
+        sched_event_remove(ids[i]);
+}
+
+int main()
+{
+    dev_id ret = 0;
+    ret = cpu_init();
+    LOG_ASSERT(ret != RET_ERR);
+    ret = ram_init();
+    LOG_ASSERT(ret != RET_ERR);
+
+    for (size_t i = 0; i < sizeof(rom); i++)
+    {
+        bus_write(i, rom[i]);
+    }
+
+    sched_reset();
+    test_event_order();
+
+    line_id = sched_register(line_name, line_sync);
+    LOG_ASSERT(line_id != RET_ERR);
+    line_event = sched_event_register(line_event_name, line_fire);
+    LOG_ASSERT(line_event != RET_ERR);
+    event_id dummy = sched_event_register(dummy_event_name, dummy_fire);
+
+    for (enum region region = 0; region < REGION_NUM; region++)
+    {
+        const struct region_timing *timing = region_timings + region;
+        sched_set_region(region);
+        sched_reset();
+        lines = 0;
+        sched_event_schedule(line_event, LINE_CYCLES);
+        sched_event_schedule(dummy, LINE_CYCLES * 3);
+        sched_event_cancel(dummy);
+
+        for (int frame = 1; frame <= 3; frame++)
+        {
+            sched_run_frame();
+            LOG_ASSERT(g_sched.frame_end == frame * timing->frame_cycles);
+            LOG_ASSERT(g_sched.clock >= g_sched.frame_end);
+            LOG_ASSERT(g_sched.clock - g_sched.frame_end < 7u * timing->cpu_div);
+            /* 帧末设备只追赶到帧边界 */
+            LOG_ASSERT(synced == g_sched.frame_end);
+            LOG_ASSERT(lines >= (u64)frame * timing->lines - 1);
+            /* 每条扫描线一个批次，加上帧结束 */
+            LOG_ASSERT(g_sched.batches <= timing->lines + 2u);
+            LOG("%s frame %d: clock %llu lines %llu batches %llu fps %f", timing->name, frame,
+                (unsigned long long)g_sched.clock, (unsigned long long)lines,
+                (unsigned long long)g_sched.batches, timing->fps);
+        }
+    }
+    sched_event_remove(dummy);
+    sched_event_remove(line_event);
+    sched_remove(line_id);
+    return 0;
+}